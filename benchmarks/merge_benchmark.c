@@ -0,0 +1,303 @@
+/*
+ * Micro-benchmarks for the posting list kernels, on the real posting lists of a version.
+ *
+ * Build and run with `make benchmark`, or by hand from the repository root:
+ *   cc -O3 -DHAVE_BZLIB -Isrc/multi_bible_search benchmarks/merge_benchmark.c -lbz2 -o merge_benchmark
+ *   ./merge_benchmark [src/multi_bible_search/data/KJV.json.pbz2]
+ *
+ * Every kernel's results are checked against the scalar ones, and the exit status is 1 if any differ.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "hashtable.h"
+#include "json_file.h"
+#include "merge.h"
+#include "accumulate.h"
+
+#define DEFAULT_INDEX "src/multi_bible_search/data/KJV.json.pbz2"
+#define REPEATS 200
+// Each kernel is timed this many times, taking turns with the others, and the best time counts
+#define ROUNDS 9
+
+// Every word of Esther 8:9, the longest verse
+static const char* long_query[] = {
+    "then", "were", "the", "kings", "scribes", "called", "at", "that", "time", "in", "the", "third", "month", "that",
+    "is", "the", "month", "sivan", "on", "the", "three", "and", "twentieth", "day", "thereof", "and", "it", "was",
+    "written", "according", "to", "all", "that", "mordecai", "commanded", "unto", "the", "jews", "and", "to", "the",
+    "lieutenants", "and", "the", "deputies", "and", "rulers", "of", "the", "provinces", "which", "are", "from", "india",
+    "unto", "ethiopia", "an", "hundred", "twenty", "and", "seven", "provinces", "unto", "every", "province", "according",
+    "to", "the", "writing", "thereof", "and", "unto", "every", "people", "after", "their", "language", "and", "to", "the",
+    "jews", "according", "to", "their", "writing", "and", "according", "to", "their", "language",
+};
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Kernel results that differ from the scalar ones
+static int mismatches = 0;
+
+static void bench_decode(const struct hashtable* ht, const char* key) {
+    const struct element* e = get_element(ht, key);
+    uint32_t* values = (uint32_t*) malloc((e->length + POSTING_BLOCK_SIZE) * sizeof(uint32_t));
+    uint32_t* reference = (uint32_t*) malloc((e->length + POSTING_BLOCK_SIZE) * sizeof(uint32_t));
+    const char* names[] = {"scalar", "ssse3"};
+    int masks[] = {0, CPU_SSSE3};
+    double best[2] = {0, 0};
+    int same[2] = {1, 1};
+    for (int round = 0; round < ROUNDS; round++) {
+        for (int v = 0; v < 2; v++) {
+            cpu_feature_mask = masks[v];
+            init_posting_tables();
+            double start = now();
+            for (int r = 0; r < REPEATS; r++) {
+                decode_postings(get_postings(ht, e), e->length, values);
+                __asm__ volatile("" : : "r"(values) : "memory");
+            }
+            double elapsed = (now() - start) / REPEATS;
+            if (round == 0 || elapsed < best[v]) {
+                best[v] = elapsed;
+            }
+            if (round == 0 && v == 0) {
+                memcpy(reference, values, e->length * sizeof(uint32_t));
+            }
+            same[v] = same[v] && !memcmp(reference, values, e->length * sizeof(uint32_t));
+        }
+    }
+    for (int v = 0; v < 2; v++) {
+        mismatches += !same[v];
+        printf("decode %-10s %-7s %8u postings %8.1f us %6.2f ns/posting %5.2fx%s\n", key, names[v], e->length,
+               best[v] * 1e6, best[v] * 1e9 / e->length, best[0] / best[v], same[v] ? "" : "  MISMATCH");
+    }
+    cpu_feature_mask = -1;
+    init_posting_tables();
+    free(values);
+    free(reference);
+}
+
+// Merge the lists of a query's words with each run kernel, as search() would for KJV alone
+static void bench_merge(const struct hashtable* ht, const char* name, const char* query) {
+    struct merge_source sources[128];
+    int k = 0;
+    size_t total = 0;
+    char words[1024];
+    strncpy(words, query, sizeof(words) - 1);
+    words[sizeof(words) - 1] = '\0';
+    for (char* word = strtok(words, " "); word != NULL && k < 128; word = strtok(NULL, " ")) {
+        const struct element* e = get_element(ht, word);
+        if (e != NULL) {
+            sources[k].postings = get_postings(ht, e);
+            sources[k].length = e->length;
+            sources[k++].weight = 1;
+            total += e->length;
+        }
+    }
+    result_pair* dest = (result_pair*) malloc((total + 1) * sizeof(result_pair));
+    result_pair* reference = (result_pair*) malloc((total + 1) * sizeof(result_pair));
+    struct arena arena;
+    reset_arena_fields(&arena);
+    const char* names[] = {"scalar", "sse4.2", "avx2"};
+    int masks[] = {0, CPU_SSE42, CPU_AVX2};
+    double best[3] = {0, 0, 0};
+    int same[3] = {1, 1, 1};
+    ptrdiff_t expected = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+        for (int v = 0; v < 3; v++) {
+            cpu_feature_mask = masks[v];
+            init_merge_kernels();
+            ptrdiff_t n = 0;
+            double start = now();
+            for (int r = 0; r < REPEATS; r++) {
+                n = merge_postings(sources, k, dest, &arena);
+                arena_reset(&arena);
+            }
+            double elapsed = (now() - start) / REPEATS;
+            if (round == 0 || elapsed < best[v]) {
+                best[v] = elapsed;
+            }
+            if (round == 0 && v == 0) {
+                expected = n;
+                memcpy(reference, dest, (n > 0 ? (size_t) n : 0) * sizeof(result_pair));
+            }
+            same[v] = same[v] && n >= 0 && n == expected;
+            for (ptrdiff_t i = 0; same[v] && i < n; i++) {
+                same[v] = dest[i].element == reference[i].element && dest[i].count == reference[i].count;
+            }
+        }
+    }
+    for (int v = 0; v < 3; v++) {
+        mismatches += !same[v];
+        printf("merge  %-24.24s %-7s %3d lists %7zu references %8.1f us %6.2f ns/reference %5.2fx%s\n", name, names[v],
+               k, total, best[v] * 1e6, best[v] * 1e9 / total, best[0] / best[v], same[v] ? "" : "  MISMATCH");
+    }
+    cpu_feature_mask = -1;
+    init_merge_kernels();
+    delete_arena(&arena);
+    free(dest);
+    free(reference);
+}
+
+// Fold planes of random counts into counters with each kernel
+static void bench_fold(void) {
+    uint64_t* planes = (uint64_t*) malloc(ACCUMULATE_PLANES * POSTING_BITMAP_WORDS * sizeof(uint64_t));
+    uint16_t* counts = (uint16_t*) calloc(ACCUMULATE_VERSES, sizeof(uint16_t));
+    uint16_t* reference = (uint16_t*) calloc(ACCUMULATE_VERSES, sizeof(uint16_t));
+    uint64_t state = 88172645463325252ull;
+    for (int i = 0; i < ACCUMULATE_PLANES * POSTING_BITMAP_WORDS; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        planes[i] = state;
+    }
+    const char* names[] = {"scalar", "sse2", "avx2"};
+    int masks[] = {0, CPU_SSE2, CPU_AVX2};
+    for (int num_planes = 1; num_planes <= 4; num_planes *= 2) {
+        double best[3] = {0, 0, 0};
+        int same[3] = {1, 1, 1};
+        for (int round = 0; round < ROUNDS; round++) {
+            for (int v = 0; v < 3; v++) {
+                cpu_feature_mask = masks[v];
+                init_accumulate_kernels();
+                memset(counts, 0, ACCUMULATE_VERSES * sizeof(uint16_t));
+                fold_planes(counts, planes, num_planes);
+                if (v == 0) {
+                    memcpy(reference, counts, ACCUMULATE_VERSES * sizeof(uint16_t));
+                }
+                same[v] &= !memcmp(reference, counts, ACCUMULATE_VERSES * sizeof(uint16_t));
+                double start = now();
+                for (int r = 0; r < REPEATS; r++) {
+                    fold_planes(counts, planes, num_planes);
+                    __asm__ volatile("" : : "r"(counts) : "memory");
+                }
+                double elapsed = (now() - start) / REPEATS;
+                if (round == 0 || elapsed < best[v]) {
+                    best[v] = elapsed;
+                }
+            }
+        }
+        for (int v = 0; v < 3; v++) {
+            mismatches += !same[v];
+            printf("fold   %d planes %-7s %8.1f us %5.2fx%s\n", num_planes, names[v], best[v] * 1e6, best[0] / best[v],
+                   same[v] ? "" : "  MISMATCH");
+        }
+    }
+    cpu_feature_mask = -1;
+    init_accumulate_kernels();
+    free(planes);
+    free(counts);
+    free(reference);
+}
+
+// Count a query's postings both ways, with the same sources as search() would have for KJV alone
+static void bench_accumulate(const struct hashtable* ht, const char* query) {
+    struct merge_source sources[128];
+    int k = 0;
+    size_t total = 0;
+    char words[1024];
+    strncpy(words, query, sizeof(words) - 1);
+    words[sizeof(words) - 1] = '\0';
+    for (char* word = strtok(words, " "); word != NULL && k < 128; word = strtok(NULL, " ")) {
+        const struct element* e = get_element(ht, word);
+        if (e != NULL) {
+            sources[k].postings = get_postings(ht, e);
+            sources[k].length = e->length;
+            sources[k++].weight = 1;
+            total += e->length;
+        }
+    }
+    result_pair* merged = (result_pair*) malloc((total + 1) * sizeof(result_pair));
+    result_pair* accumulated = (result_pair*) malloc((total + 1) * sizeof(result_pair));
+    struct verse_accumulator acc;
+    reset_accumulator(&acc);
+    prepare_accumulator(&acc);
+    struct arena arena;
+    reset_arena_fields(&arena);
+    ptrdiff_t merged_count = 0;
+    size_t accumulated_count = 0;
+
+    double merge_time = 0, accumulate_time = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+        double start = now();
+        for (int r = 0; r < REPEATS; r++) {
+            merged_count = merge_postings(sources, k, merged, &arena);
+            arena_reset(&arena);
+        }
+        double elapsed = (now() - start) / REPEATS;
+        if (round == 0 || elapsed < merge_time) {
+            merge_time = elapsed;
+        }
+        start = now();
+        for (int r = 0; r < REPEATS; r++) {
+            accumulated_count = accumulate_postings(&acc, sources, k, accumulated);
+        }
+        elapsed = (now() - start) / REPEATS;
+        if (round == 0 || elapsed < accumulate_time) {
+            accumulate_time = elapsed;
+        }
+    }
+
+    int same = merged_count >= 0 && (size_t) merged_count == accumulated_count;
+    for (size_t i = 0; same && i < accumulated_count; i++) {
+        same = merged[i].element == accumulated[i].element && merged[i].count == accumulated[i].count;
+    }
+    mismatches += !same;
+    printf("count  %-28.28s %2d lists %6zu postings  merge %7.1f us  accumulate %7.1f us %5.2fx%s\n", query, k, total,
+           merge_time * 1e6, accumulate_time * 1e6, merge_time / accumulate_time, same ? "" : "  MISMATCH");
+    delete_accumulator(&acc);
+    delete_arena(&arena);
+    free(merged);
+    free(accumulated);
+}
+
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : DEFAULT_INDEX;
+    struct hashtable ht;
+    reset_table(&ht);
+    int error = load_json_file(path, &ht);
+    if (error) {
+        fprintf(stderr, "Unable to load %s: %s\n", path, index_error_string(error));
+        return 1;
+    }
+    cpu_feature_mask = -1;
+    printf("CPU features: %s%s%s%s\n", cpu_features() & CPU_SSE2 ? "sse2 " : "", cpu_features() & CPU_SSSE3 ? "ssse3 " : "",
+           cpu_features() & CPU_SSE42 ? "sse4.2 " : "", cpu_features() & CPU_AVX2 ? "avx2" : "");
+
+    bench_decode(&ht, "the");
+    bench_decode(&ht, "lord");
+    char long_text[1024] = "";
+    for (size_t i = 0; i < sizeof(long_query) / sizeof(long_query[0]); i++) {
+        strcat(long_text, long_query[i]);
+        strcat(long_text, " ");
+    }
+    bench_merge(&ht, "jesus wept", "jesus wept");
+    bench_merge(&ht, "jesus christ", "jesus christ");
+    bench_merge(&ht, "the lord", "the lord");
+    bench_merge(&ht, "god lord", "god lord");
+    bench_merge(&ht, "the lord is my shepherd", "the lord is my shepherd");
+    bench_merge(&ht, "and the lord spake unto moses", "and the lord spake unto moses saying");
+    bench_merge(&ht, "Esther 8:9", long_text);
+
+    cpu_feature_mask = -1;
+    init_posting_tables();
+    init_merge_kernels();
+    init_accumulate_kernels();
+    init_verse_tables();
+    bench_fold();
+    bench_accumulate(&ht, "jesus wept");
+    bench_accumulate(&ht, "the lord is my shepherd");
+    bench_accumulate(&ht, "in the beginning god created the heaven and the earth");
+    bench_accumulate(&ht, "and the lord spake unto moses saying");
+    bench_accumulate(&ht, "for god so loved the world that he gave his only begotten son");
+    bench_accumulate(&ht, long_text);
+
+    delete_table(&ht);
+    if (mismatches) {
+        fprintf(stderr, "%d kernel results differ from the scalar ones\n", mismatches);
+        return 1;
+    }
+    return 0;
+}
@@ -8,8 +8,9 @@ import copy
 import bz2
 import multiprocessing
 import re
+import sys
 import time
-from typing import List
+from typing import List, Union
 from multiprocessing.managers import DictProxy
 
 import numpy
@@ -67,22 +68,65 @@ def tokenize(input_string: str) -> List[str]:
     return remove_punctuation(input_string.replace("I-chabod", "Ichabod").lower()).split()
 
 
-# pylint: disable=too-many-branches,too-many-nested-blocks
-def index_bible(bible, name: str, result: DictProxy) -> None:
+# Positions a verse has room for in the positional index. This matches positions.h.
+POSITION_LIMIT = 1024
+
+
+def index_tokens(input_string: str) -> List[str]:
+    """
+    Gets the tokens of a verse that are indexed, in order, with the source's quirks evened out.
+    :param input_string: The text of the verse.
+    :return: A list of the tokens to index.
+    """
+    result = []
+    for token in tokenize(input_string):
+        if len(token) == 1 and token != "a":
+            continue
+        # XML source issue
+        if token in {
+            "lxx", "syr", "vg", "heb", "etc", "isha", "ish", "aleph", "kol"
+        }:
+            continue
+        # ????
+        if token == 'ij':
+            token = "i"
+        # Typo in the source?
+        elif token == "ad":
+            token = "and"
+        # Make this the same
+        elif token == 'aramnaharaim':
+            result.extend(("aram", "naharaim"))
+            continue
+        try:
+            token.encode("ascii")
+        except UnicodeError:
+            continue
+        result.append(token)
+    return result
+
+
+# pylint: disable=too-many-nested-blocks
+def index_bible(bible, name: str, result: DictProxy, positions: Union[DictProxy, None] = None) -> None:
     """
     Builds the (reverse) index of a given Bible version.
     :param bible: Bible object used for indexing.
     :param name: The Short name of the version being indexed.
     :param result: Resulting dictionary to add the version's index to.
+    :param positions: Resulting dictionary to add the version's positional index to, if one is wanted. It maps each
+    token to `verse_id * POSITION_LIMIT + position` for every place it is, a position counting the indexed tokens of
+    the verse.
     :return: None
     """
     tmp_index = {}
+    tmp_positions = {}
 
     # Iterate through the Bible
     for book in bible.books_of_the_bible.keys():
         for chapter in range(1, bible.books_of_the_bible[book] + 1):
             # Get the chapter
             passage_result = bible.get_passage(book, chapter)['verses']
+            # Next position of each verse of the chapter, as a verse split by a heading carries on after it
+            next_position = {}
             # Go through the verses
             for heading in passage_result.keys():
                 # Tokenize each verse, adding its reference
@@ -94,39 +138,24 @@ def index_bible(bible, name: str, result: DictProxy) -> None:
                         verse = previous_verse
                     else:
                         previous_verse = verse
-                    tokens = list(set(tokenize(this_passage[this_passage.find(" "):])))
+                    tokens = index_tokens(this_passage[this_passage.find(" "):])
                     reference = translate(book, chapter, verse)
-                    for token in tokens:
-                        if len(token) == 1 and token != "a":
-                            continue
-                        # XML source issue
-                        if token in {
-                            "lxx", "syr", "vg", "heb", "etc", "isha", "ish", "aleph", "kol"
-                        }:
-                            continue
-                        # ????
-                        if token == 'ij':
-                            token = "i"
-                        # Typo in the source?
-                        elif token == "ad":
-                            token = "and"
-                        # Make this the same
-                        elif token == 'aramnaharaim':
-                            if "aram" not in tmp_index:
-                                tmp_index["aram"] = []
-                            if "naharaim" not in tmp_index:
-                                tmp_index["naharaim"] = []
-                            tmp_index["aram"].append(reference)
-                            tmp_index["naharaim"].append(reference)
-                            continue
-                        try:
-                            token.encode("ascii")
-                        except UnicodeError:
-                            continue
+                    if positions is not None:
+                        position = next_position.get(reference, 0)
+                        for token in tokens[:max(POSITION_LIMIT - position, 0)]:
+                            tmp_positions.setdefault(token, []).append(reference * POSITION_LIMIT + position)
+                            position += 1
+                        next_position[reference] = position
+                    for token in set(tokens):
                         if token not in tmp_index:
                             tmp_index[token] = []
-                        tmp_index[token].append(reference)
+                        # A verse split by a heading comes up once for each part, but is only listed once,
+                        # or separate_duplicates would only move one of them
+                        if not tmp_index[token] or tmp_index[token][-1] != reference:
+                            tmp_index[token].append(reference)
     result.update({name: tmp_index})
+    if positions is not None:
+        positions.update({name: tmp_positions})
 
 
 def separate_duplicates(index: dict, versions: list, combine_to: str) -> dict:
@@ -210,10 +239,11 @@ def separate_duplicates_mp(index: DictProxy, versions: list, combine_to: str) ->
 
 
 # pylint: disable=too-many-locals,consider-using-with
-def make_index(bibles_in: dict) -> dict:
+def make_index(bibles_in: dict, positions: Union[dict, None] = None) -> dict:
     """
     Build the (reverse) src index of the given Bibles.
     :param bibles_in: A dictionary of Bible objects where the name of the version is the key.
+    :param positions: Dictionary to add the positional index of each version to (see `index_bible`), if wanted.
     :return: Dictionary of src index for each version.
     """
 
@@ -221,12 +251,13 @@ def make_index(bibles_in: dict) -> dict:
     num_processes = multiprocessing.cpu_count()
     manager = multiprocessing.Manager()
     built_index = manager.dict({})
+    built_positions = manager.dict({}) if positions is not None else None
     versions = list(bibles_in.keys())
     pool = multiprocessing.Pool(processes=num_processes)
 
     # Spread out work to the pool
     for version in versions:
-        pool.apply_async(index_bible, args=(bibles_in[version], version, built_index,))
+        pool.apply_async(index_bible, args=(bibles_in[version], version, built_index, built_positions,))
 
     # Start, do the work, and wait for results
     pool.close()
@@ -236,6 +267,10 @@ def make_index(bibles_in: dict) -> dict:
     # pylint: disable=no-member,protected-access
     # index = built_index._getvalue()
 
+    # Positions are per version, so they aren't split into the combined indices below
+    if positions is not None:
+        positions.update(built_positions._getvalue())
+
     pool = multiprocessing.Pool(processes=num_processes)
     # Separate some duplicates
     print("Built primary index. Removing some duplicates across all versions of each language...")
@@ -343,10 +378,13 @@ if __name__ == '__main__':
         'RV1960': RV1960(),
         'RV2004': RV2004(),
     }
+    # Positional indices, for phrase searches, are only built when asked for
+    version_positions = {} if "--positions" in sys.argv[1:] else None
+
     # Timer start, because I like stats
     start = time.perf_counter()
 
-    reference_index = make_index(bibles)
+    reference_index = make_index(bibles, version_positions)
 
     key_list = []
     # Save each version's index as a separate file to be able to load them independently.
@@ -354,6 +392,10 @@ if __name__ == '__main__':
         save(reference_index[key], key)
         key_list.extend(reference_index[key].keys())
 
+    if version_positions is not None:
+        for key, value in version_positions.items():
+            save(value, f"{key}.positions")
+
     key_list = list(set(key_list))
     key_list.sort()
     with open("../keys.txt", "w", encoding="utf-8") as key_file:
@@ -2,9 +2,13 @@
 Set up the multi-bible-search extension.
 """
 import os
+import tempfile
 
 # pylint: disable=import-error
 from setuptools import setup, Extension
+# pylint: disable=deprecated-module
+from distutils.ccompiler import new_compiler
+from distutils.errors import CompileError, LinkError
 
 
 tune_native = os.getenv("TUNE_NATIVE", "").lower() in {"1", "true", "yes"}
@@ -33,6 +37,38 @@ else:
         print("Running native build")
         flags.append("-march=native")  # At this point, this has a negligible impact, same as MSVC
 
+
+
+def has_bzip2() -> bool:
+    """
+    Check whether libbz2 can be compiled and linked against,
+    so that indices can be decompressed on the C side of things.
+    :return: True if bzip2 is available.
+    """
+    compiler = new_compiler()
+    with tempfile.TemporaryDirectory() as temp_dir:
+        source = os.path.join(temp_dir, "bz2_check.c")
+        with open(source, "w", encoding="utf-8") as source_file:
+            source_file.write(
+                "#include <bzlib.h>\n"
+                "int main(void) { bz_stream s = {0}; return BZ2_bzDecompressInit(&s, 0, 0); }\n"
+            )
+        try:
+            objects = compiler.compile([source], output_dir=temp_dir)
+            compiler.link_executable(objects, "bz2_check", output_dir=temp_dir, libraries=["bz2"])
+        except (CompileError, LinkError):
+            return False
+    return True
+
+
+define_macros = []
+libraries = []
+if has_bzip2():
+    define_macros.append(("HAVE_BZLIB", "1"))
+    libraries.append("bz2")
+else:
+    print("bzip2 not found, building without native decompression")
+
 setup(
     name='multi_bible_search',
     ext_modules=[
@@ -40,6 +76,8 @@ setup(
                   ['src/multi_bible_search/multi_bible_search.c'],
                   include_dirs=['src/multi_bible_search/'],
                   extra_compile_args=flags,
+                  define_macros=define_macros,
+                  libraries=libraries,
                   )
     ],
 )
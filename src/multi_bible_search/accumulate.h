@@ -0,0 +1,276 @@
+#ifndef ACCUMULATE_H
+#define ACCUMULATE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "cpu_features.h"
+#include "postings.h"
+#include "merge.h"
+#include "verses.h"
+
+/*
+ * The other way to count a query's references: a counter per verse, indexed by verse ID (see verses.h), that every
+ * posting just increments. A posting costs about the same however many lists there are, where merging costs more
+ * with every doubling of them, but collecting the counters is a pass over all of them. So queries are accumulated
+ * once merging them would be enough work.
+ *
+ * Lists stored as bitmaps aren't decoded at all. They're added up a word (64 verses) at a time into bit-sliced counts,
+ * where bit v of plane p is bit p of the count of verse v, which only takes a few planes however many bitmaps there
+ * are. The planes are folded into the counters before they're collected.
+ */
+
+// Total length of a query's posting lists times the times they're merged over (the ceiling of the log2 of their
+// number) from which they're accumulated instead
+#ifndef ACCUMULATE_MIN_WORK
+#define ACCUMULATE_MIN_WORK 16000
+#endif
+
+// Past this many verses counted, they're collected by scanning every counter instead of sorting those touched
+#define ACCUMULATE_SCAN_TOUCHED (NUM_VERSES / 16)
+// Counters for every bit of a bitmap, so that the planes fold into them a word at a time
+#define ACCUMULATE_VERSES (POSTING_BITMAP_WORDS * 64)
+// Bits of a count, as they're 16-bit
+#define ACCUMULATE_PLANES 16
+
+struct verse_accumulator
+{
+    // Count of each verse, all 0 between queries
+    uint16_t* counts;
+    // IDs of the verses counted so far, each once, so that only they need to be reset
+    uint16_t* touched;
+    uint32_t num_touched;
+    // Scratch space for sorting the touched IDs
+    uint16_t* sorted;
+    // Bit-sliced counts of the bitmaps, ACCUMULATE_PLANES planes of POSTING_BITMAP_WORDS words, all 0 between queries
+    uint64_t* planes;
+};
+
+static inline void reset_accumulator(struct verse_accumulator* acc) {
+    acc->counts = NULL;
+    acc->touched = NULL;
+    acc->num_touched = 0;
+    acc->sorted = NULL;
+    acc->planes = NULL;
+}
+
+static inline void delete_accumulator(struct verse_accumulator* acc) {
+    free(acc->counts);
+    free(acc->touched);
+    free(acc->sorted);
+    free(acc->planes);
+    reset_accumulator(acc);
+}
+
+// Allocate the accumulator if it isn't yet. Returns 0 on success, or -1 if memory runs out
+static inline int prepare_accumulator(struct verse_accumulator* acc) {
+    if (acc->counts != NULL) {
+        return 0;
+    }
+    acc->counts = (uint16_t*) calloc(ACCUMULATE_VERSES, sizeof(uint16_t));
+    // The touched list is written one past its end before each check
+    acc->touched = (uint16_t*) malloc((NUM_VERSES + 1) * sizeof(uint16_t));
+    acc->sorted = (uint16_t*) malloc(NUM_VERSES * sizeof(uint16_t));
+    acc->planes = (uint64_t*) calloc(ACCUMULATE_PLANES * POSTING_BITMAP_WORDS, sizeof(uint64_t));
+    if (acc->counts == NULL || acc->touched == NULL || acc->sorted == NULL || acc->planes == NULL) {
+        delete_accumulator(acc);
+        return -1;
+    }
+    return 0;
+}
+
+// Whether the sources of a query are better accumulated than merged
+static inline int should_accumulate(const struct merge_source* sources, int num_sources) {
+    size_t total = 0;
+    uint32_t max_count = 0,
+             depth = 0;
+    for (int i = 0; i < num_sources; i++) {
+        total += sources[i].length;
+        max_count += (uint32_t) sources[i].weight;
+    }
+    while ((1 << depth) < num_sources) {
+        depth++;
+    }
+    return total * depth >= ACCUMULATE_MIN_WORK && max_count <= UINT16_MAX;
+}
+
+// Sort the touched IDs in place, a byte at a time
+static inline void sort_touched(struct verse_accumulator* acc) {
+    uint32_t low[257] = {0},
+             high[257] = {0};
+    for (uint32_t i = 0; i < acc->num_touched; i++) {
+        low[(acc->touched[i] & 0xFF) + 1]++;
+        high[(acc->touched[i] >> 8) + 1]++;
+    }
+    for (int i = 1; i < 257; i++) {
+        low[i] += low[i - 1];
+        high[i] += high[i - 1];
+    }
+    for (uint32_t i = 0; i < acc->num_touched; i++) {
+        acc->sorted[low[acc->touched[i] & 0xFF]++] = acc->touched[i];
+    }
+    for (uint32_t i = 0; i < acc->num_touched; i++) {
+        acc->touched[high[acc->sorted[i] >> 8]++] = acc->sorted[i];
+    }
+}
+
+// Add a bitmap `weight` times to the planes, a word at a time, carrying into higher planes like addition
+static inline void add_bitmap(struct verse_accumulator* acc, const uint8_t* bitmap, uint16_t weight) {
+    uint64_t* planes = acc->planes;
+    for (int bit = 0; bit < ACCUMULATE_PLANES; bit++) {
+        if (!(weight & (1u << bit))) {
+            continue;
+        }
+        for (uint32_t word = 0; word < POSTING_BITMAP_WORDS; word++) {
+            uint64_t carry = bitmap_word(bitmap, word);
+            for (int plane = bit; carry; plane++) {
+                uint64_t* sum = &planes[plane * POSTING_BITMAP_WORDS + word];
+                uint64_t next = *sum & carry;
+                *sum ^= carry;
+                carry = next;
+            }
+        }
+    }
+}
+
+/*
+ * Kernels adding the counts in the first `num_planes` planes to the counters.
+ * The vectorized ones spread each run of a plane's bits over as many counters, a lane each.
+ */
+typedef void (*fold_kernel)(uint16_t* counts, const uint64_t* planes, int num_planes);
+
+static void fold_planes_scalar(uint16_t* counts, const uint64_t* planes, int num_planes) {
+    for (int plane = 0; plane < num_planes; plane++) {
+        const uint64_t* words = &planes[plane * POSTING_BITMAP_WORDS];
+        for (uint32_t word = 0; word < POSTING_BITMAP_WORDS; word++) {
+            for (uint64_t bits = words[word]; bits; bits &= bits - 1) {
+                counts[word * 64 + lowest_bit(bits)] += (uint16_t) (1u << plane);
+            }
+        }
+    }
+}
+
+#ifdef CPU_X86_SIMD
+TARGET_SSE2 static void fold_planes_sse2(uint16_t* counts, const uint64_t* planes, int num_planes) {
+    const __m128i lanes = _mm_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128);
+    for (uint32_t word = 0; word < POSTING_BITMAP_WORDS; word++) {
+        for (int group = 0; group < 8; group++) {
+            __m128i sum = _mm_setzero_si128();
+            for (int plane = 0; plane < num_planes; plane++) {
+                uint64_t bits = planes[plane * POSTING_BITMAP_WORDS + word] >> (8 * group);
+                __m128i set = _mm_and_si128(_mm_set1_epi16((short) (bits & 0xFF)), lanes);
+                set = _mm_cmpeq_epi16(set, lanes);
+                sum = _mm_add_epi16(sum, _mm_and_si128(set, _mm_set1_epi16((short) (1u << plane))));
+            }
+            __m128i* out = (__m128i*) &counts[word * 64 + group * 8];
+            _mm_storeu_si128(out, _mm_add_epi16(_mm_loadu_si128(out), sum));
+        }
+    }
+}
+
+TARGET_AVX2 static void fold_planes_avx2(uint16_t* counts, const uint64_t* planes, int num_planes) {
+    const __m256i lanes = _mm256_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384,
+                                            (short) 32768);
+    for (uint32_t word = 0; word < POSTING_BITMAP_WORDS; word++) {
+        for (int group = 0; group < 4; group++) {
+            __m256i sum = _mm256_setzero_si256();
+            for (int plane = 0; plane < num_planes; plane++) {
+                uint64_t bits = planes[plane * POSTING_BITMAP_WORDS + word] >> (16 * group);
+                __m256i set = _mm256_and_si256(_mm256_set1_epi16((short) (bits & 0xFFFF)), lanes);
+                set = _mm256_cmpeq_epi16(set, lanes);
+                sum = _mm256_add_epi16(sum, _mm256_and_si256(set, _mm256_set1_epi16((short) (1u << plane))));
+            }
+            __m256i* out = (__m256i*) &counts[word * 64 + group * 16];
+            _mm256_storeu_si256(out, _mm256_add_epi16(_mm256_loadu_si256(out), sum));
+        }
+    }
+}
+#endif
+
+// Fold kernel for this CPU, picked by `init_accumulate_kernels`
+static fold_kernel fold_planes = fold_planes_scalar;
+
+// Pick the fold kernel. Call once before accumulating anything
+static inline void init_accumulate_kernels(void) {
+    fold_planes = fold_planes_scalar;
+#ifdef CPU_X86_SIMD
+    int features = cpu_features();
+    if (features & CPU_AVX2) {
+        fold_planes = fold_planes_avx2;
+    }
+    else if (features & CPU_SSE2) {
+        fold_planes = fold_planes_sse2;
+    }
+#endif
+}
+
+/*
+ * Count the references of every source into `dest`, like merge_postings, with the accumulator.
+ * `dest` needs room for one more result than the total length of the sources.
+ * Returns the number of results, leaving the accumulator cleared.
+ */
+static inline size_t accumulate_postings(struct verse_accumulator* acc, const struct merge_source* sources,
+                                         int num_sources, result_pair * restrict dest) {
+    uint16_t* restrict counts = acc->counts;
+    uint16_t* touched = acc->touched;
+    uint32_t num_touched = 0,
+             bitmap_weight = 0;
+    struct posting_cursor cursor;
+
+    for (int s = 0; s < num_sources; s++) {
+        uint16_t weight = (uint16_t) sources[s].weight;
+        if (is_bitmap_postings(sources[s].length)) {
+            add_bitmap(acc, sources[s].postings, weight);
+            bitmap_weight += weight;
+            continue;
+        }
+        cursor_init(&cursor, sources[s].postings, sources[s].length);
+        while (cursor_next_block(&cursor)) {
+            for (uint32_t i = 0; i < cursor.count; i++) {
+                uint32_t verse = cursor.values[i];
+                // Without branching, add the verse to the touched list the first time it's counted
+                touched[num_touched] = (uint16_t) verse;
+                num_touched += counts[verse] == 0;
+                counts[verse] += weight;
+            }
+        }
+    }
+    acc->num_touched = num_touched;
+
+    // The bitmaps' counts can be anywhere, so they need the whole scan
+    if (bitmap_weight) {
+        // Only planes up to the highest bit of the total can have been carried into
+        int num_planes = 0;
+        while (bitmap_weight >> num_planes) {
+            num_planes++;
+        }
+        fold_planes(counts, acc->planes, num_planes);
+        memset(acc->planes, 0, num_planes * POSTING_BITMAP_WORDS * sizeof(uint64_t));
+    }
+
+    // Collect the counted verses in reference order, clearing their counters on the way
+    size_t n = 0;
+    if (bitmap_weight || num_touched > ACCUMULATE_SCAN_TOUCHED) {
+        // Every verse is written, but only those counted are kept
+        for (uint32_t verse = 0; verse < NUM_VERSES; verse++) {
+            dest[n].element = verse;
+            dest[n].count = counts[verse];
+            n += counts[verse] != 0;
+        }
+        memset(counts, 0, ACCUMULATE_VERSES * sizeof(uint16_t));
+    }
+    else {
+        sort_touched(acc);
+        for (uint32_t i = 0; i < num_touched; i++) {
+            uint16_t verse = touched[i];
+            dest[n].element = verse;
+            dest[n++].count = counts[verse];
+            counts[verse] = 0;
+        }
+    }
+    acc->num_touched = 0;
+    return n;
+}
+
+#endif
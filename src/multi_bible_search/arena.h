@@ -0,0 +1,116 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/*
+ * Scratch memory for a search: everything it needs is bumped off one block and let go of at once when it's done.
+ * What doesn't fit gets its own allocation until then, and the block grows (doubling, at least to everything the
+ * search needed) for the next, so that searches after the first few don't allocate at all.
+ */
+
+// Alignment of every allocation, enough for any of the search's types (and SSE)
+#define ARENA_ALIGNMENT 16
+// Largest block kept between searches, so that the odd huge query doesn't hold on to its memory
+#ifndef ARENA_MAX_RETAINED
+#define ARENA_MAX_RETAINED (4u << 20)
+#endif
+
+// An allocation that didn't fit in the block, its memory following (aligned)
+struct arena_chunk
+{
+    struct arena_chunk* next;
+};
+
+struct arena
+{
+    uint8_t* block;
+    size_t size;
+    size_t used;
+    struct arena_chunk* chunks;
+    // Memory used in chunks since the last reset
+    size_t chunk_bytes;
+};
+
+static inline void reset_arena_fields(struct arena* arena) {
+    arena->block = NULL;
+    arena->size = 0;
+    arena->used = 0;
+    arena->chunks = NULL;
+    arena->chunk_bytes = 0;
+}
+
+static inline void arena_free_chunks(struct arena* arena) {
+    while (arena->chunks != NULL) {
+        struct arena_chunk* next = arena->chunks->next;
+        free(arena->chunks);
+        arena->chunks = next;
+    }
+    arena->chunk_bytes = 0;
+}
+
+static inline void delete_arena(struct arena* arena) {
+    arena_free_chunks(arena);
+    free(arena->block);
+    reset_arena_fields(arena);
+}
+
+// Allocate `size` bytes, or NULL if memory runs out
+static inline void* arena_alloc(struct arena* arena, size_t size) {
+    size = (size + ARENA_ALIGNMENT - 1) & ~(size_t) (ARENA_ALIGNMENT - 1);
+    if (size == 0) {
+        size = ARENA_ALIGNMENT;
+    }
+    if (arena->size - arena->used >= size) {
+        void* memory = arena->block + arena->used;
+        arena->used += size;
+        return memory;
+    }
+    struct arena_chunk* chunk = (struct arena_chunk*) malloc(sizeof(struct arena_chunk) + ARENA_ALIGNMENT + size);
+    if (chunk == NULL) {
+        return NULL;
+    }
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    arena->chunk_bytes += size;
+    return (void*) (((uintptr_t) (chunk + 1) + ARENA_ALIGNMENT - 1) & ~(uintptr_t) (ARENA_ALIGNMENT - 1));
+}
+
+// Allocate `count` zeroed elements of `size` bytes, or NULL if memory runs out
+static inline void* arena_calloc(struct arena* arena, size_t count, size_t size) {
+    void* memory = arena_alloc(arena, count * size);
+    if (memory != NULL) {
+        memset(memory, 0, count * size);
+    }
+    return memory;
+}
+
+// Let go of everything allocated, growing the block to fit it all next time
+static inline void arena_reset(struct arena* arena) {
+    size_t needed = arena->used + arena->chunk_bytes;
+    arena_free_chunks(arena);
+    arena->used = 0;
+    if (needed <= arena->size || arena->size >= ARENA_MAX_RETAINED) {
+        return;
+    }
+    size_t size = arena->size ? arena->size * 2 : 4096;
+    while (size < needed) {
+        size *= 2;
+    }
+    if (size > ARENA_MAX_RETAINED) {
+        size = ARENA_MAX_RETAINED;
+    }
+    // Block memory is aligned like malloc's, which is at least the alignment on the platforms this builds for
+    uint8_t* block = (uint8_t*) malloc(size);
+    if (block == NULL) {
+        return;
+    }
+    free(arena->block);
+    arena->block = block;
+    arena->size = size;
+}
+
+#endif
@@ -6,28 +6,48 @@ by automatically managing version indexes which the C class does not do.
 import bz2
 import os
 import sys
-from typing import List, Union
+from typing import Dict, List, Sequence, Tuple, Union
 
 # PyCharm and Pylint both can't figure this one out,
 # but it works and is correct.
 # pylint: disable=no-name-in-module
-from .multi_bible_search import BibleSearch as cBibleSearch
+from .multi_bible_search import BibleSearch as cBibleSearch, ResultArray
 from .invalid_version import InvalidVersion
 
 
+def _index_dirs() -> List[str]:
+    """
+    Gets the directories binary indexes are cached in, in the order they're tried: the package's data directory,
+    then a per-user cache directory for when that one is read-only.
+    :return: The directories, which may not exist yet.
+    """
+    data_dir = os.path.join(os.path.dirname(os.path.abspath(__file__)), "data")
+    if sys.platform == "win32":
+        cache_dir = os.environ.get("LOCALAPPDATA") or os.path.expanduser(os.path.join("~", "AppData", "Local"))
+    else:
+        cache_dir = os.environ.get("XDG_CACHE_HOME") or os.path.expanduser(os.path.join("~", ".cache"))
+    return [data_dir, os.path.join(cache_dir, "multi_bible_search")]
+
+
 class BibleSearch:
     """
     Search versions of the Bible
     """
-    def __init__(self, preload: Union[List[str], None] = None):
+    def __init__(self, preload: Union[List[str], None] = None, cache_size: int = 0):
         """
         :param preload: List of versions to preload.
+        :param cache_size: Memory in bytes to cache the results of recent queries in, or 0 not to.
         """
         # (C) Search object
         self.__c_search = cBibleSearch()
+        if cache_size:
+            self.__c_search.set_cache_size(cache_size)
 
         try:
-            if len(os.listdir(os.path.join(__file__[:-23], "data"))) < 40:
+            if len([
+                    x for x in os.listdir(os.path.join(__file__[:-23], "data"))
+                    if x.endswith(".pbz2")
+            ]) < 40:
                 from .bible_downloader import BibleDownloader
 
                 downloader = BibleDownloader()
@@ -65,6 +85,8 @@ class BibleSearch:
         # What is currently stored in C
         self.__loaded: set = set()
         self.__preloaded: set = set()
+        # Versions whose positional index (for phrase searches) is loaded
+        self.__positions: set = set()
 
         if preload:
             for version in preload:
@@ -74,18 +96,63 @@ class BibleSearch:
         """
         Preloads a given version's search index.
         It assumes that the version is valid.
+        The binary form of the index is memory-mapped when possible. Otherwise, the compressed
+        JSON index is loaded (without holding the GIL when bzip2 is available) and then cached in
+        binary form for next time.
         :param version: The version to preload.
         :return: None
         """
         base_path = os.path.dirname(os.path.abspath(__file__))
-        with bz2.open(
-                f"{base_path}/data/{version}.json.pbz2",
-                "rt",
-                encoding='utf-8'
-        ) as data_file:
-            self.__c_search.load(data_file.read(), version)
+        json_path = f"{base_path}/data/{version}.json.pbz2"
+        index_paths = [os.path.join(index_dir, f"{version}.idx") for index_dir in _index_dirs()]
+        for index_path in index_paths:
+            try:
+                # A stale binary index (e.g., the JSON was re-downloaded) is rebuilt below
+                if os.path.getmtime(index_path) >= os.path.getmtime(json_path):
+                    self.__c_search.load_index(index_path, version)
+                    if not preload:
+                        self.__loaded.add(version)
+                    return
+            except (OSError, RuntimeError):
+                # Missing, unreadable, or from an older version of this module
+                pass
+
+        try:
+            # Decompress and parse on the C side of things
+            self.__c_search.load_file(json_path, version)
+        except RuntimeError:
+            # Built without bzip2, so decompress here instead
+            with bz2.open(
+                    json_path,
+                    "rt",
+                    encoding='utf-8'
+            ) as data_file:
+                self.__c_search.load(data_file.read(), version)
         if not preload:
             self.__loaded.add(version)
+        self._save_index(version, index_paths)
+
+    def _save_index(self, version: str, index_paths: List[str]) -> None:
+        """
+        Caches a loaded version's index in binary form, in the first of the given places that can be written to.
+        This is best effort, since the package directory may well be read-only, and so may the others.
+        :param version: The loaded version to save.
+        :param index_paths: Where to try to save the binary index, in order.
+        :return: None
+        """
+        for index_path in index_paths:
+            temp_path = f"{index_path}.{os.getpid()}.tmp"
+            try:
+                os.makedirs(os.path.dirname(index_path), exist_ok=True)
+                self.__c_search.save_index(version, temp_path)
+                # Atomic, so concurrent workers never map a partially written file
+                os.replace(temp_path, index_path)
+                return
+            except OSError:
+                try:
+                    os.remove(temp_path)
+                except OSError:
+                    pass
 
     def load(self, version: str) -> None:
         """
@@ -163,6 +230,7 @@ class BibleSearch:
         if version in self.__versions and version in self.__loaded:
             self.__c_search.unload(version)
             self.__loaded.remove(version)
+            self.__positions.discard(version)
         else:
             raise InvalidVersion(version)
 
@@ -174,7 +242,8 @@ class BibleSearch:
     ) -> List[str]:
         """
         Search for a passage in the Bible.
-        :param query: The search query string.
+        :param query: The search query string. A word ending in `*` (e.g., `prophe*`) matches every word starting
+        with it.
         :param version: The version to search.
         :param max_results: The maximum number of results to retrieve.
         :return: List of match references (e.g., `["John 11:35", "Matthew 1:7", ...]`).
@@ -184,6 +253,143 @@ class BibleSearch:
             self.load(version)
         return self.__c_search.search(query, version, max_results)
 
+    def search_boolean(
+            self,
+            query: str,
+            version: str = "KJV",
+            max_results: int = sys.maxsize
+    ) -> List[str]:
+        """
+        Search for the verses with every word of a query, except that those written as `-word` are words they must not
+        have (e.g., `"love -hate"`). Words ending in `*` are prefixes, like in `search`.
+        :param query: The search query string.
+        :param version: The version to search.
+        :param max_results: The maximum number of results to retrieve.
+        :return: List of match references, in the order of the Bible.
+        """
+        if version not in self.__loaded:
+            self.load(version)
+        return self.__c_search.search_boolean(query, version, max_results)
+
+    def load_positions(self, version: str) -> None:
+        """
+        Loads a version's positional index, for phrase searches, from `data/<version>.positions.json.pbz2`.
+        These are only there if the index was built with `--positions`.
+        :param version: The version to load the positions of.
+        :return: None
+        :raises InvalidVersion: For invalid version strings.
+        :raises OSError: If the version has no positional index.
+        """
+        if version not in self.__versions:
+            raise InvalidVersion(version)
+        if version in self.__positions:
+            return
+        base_path = os.path.dirname(os.path.abspath(__file__))
+        self.__c_search.load_positions(f"{base_path}/data/{version}.positions.json.pbz2", version)
+        self.__positions.add(version)
+
+    def search_phrase(
+            self,
+            phrase: str,
+            version: str = "KJV",
+            max_results: int = sys.maxsize
+    ) -> List[str]:
+        """
+        Search for the verses with a phrase: its words next to each other, in order. Words that aren't indexed
+        (single letters other than "a") are skipped, in the phrase as in the verses.
+        :param phrase: The phrase to search for.
+        :param version: The version to search.
+        :param max_results: The maximum number of results to retrieve.
+        :return: List of match references, in the order of the Bible.
+        :raises OSError: If the version has no positional index.
+        """
+        if version not in self.__loaded:
+            self.load(version)
+        self.load_positions(version)
+        return self.__c_search.search_phrase(phrase, version, max_results)
+
+    def search_ids(
+            self,
+            query: str,
+            version: str = "KJV",
+            max_results: int = sys.maxsize,
+            with_counts: bool = False
+    ) -> Union[ResultArray, Tuple[ResultArray, ResultArray]]:
+        """
+        Search for a passage in the Bible, getting the verse IDs of the results (see `translate`) instead of their
+        references as strings. They're packed `uint32` values, read through the buffer protocol
+        (e.g., `memoryview(ids)` or `numpy.frombuffer(ids, dtype=numpy.uint32)`) without copying them.
+        :param query: The search query string.
+        :param version: The version to search.
+        :param max_results: The maximum number of results to retrieve.
+        :param with_counts: Whether to also get how many of the query's tokens each result matched.
+        :return: The verse IDs in the order `search` returns their references, along with their counts if asked for.
+        """
+        if version not in self.__loaded:
+            self.load(version)
+        return self.__c_search.search_ids(query, version, max_results, with_counts)
+
+    def search_many(
+            self,
+            queries: Sequence[str],
+            version: str = "KJV",
+            max_results: int = sys.maxsize,
+            threads: Union[int, None] = None
+    ) -> List[List[str]]:
+        """
+        Search for many passages in the same version of the Bible at once, spreading the queries over native
+        threads without holding the GIL.
+        :param queries: The search query strings.
+        :param version: The version to search.
+        :param max_results: The maximum number of results to retrieve for each query.
+        :param threads: The number of threads to search with. Defaults to one per CPU.
+        :return: List of the results of each query, as `search` would return them.
+        """
+        if version not in self.__loaded:
+            self.load(version)
+        if threads is None:
+            threads = os.cpu_count() or 1
+        return self.__c_search.search_many(queries, version, max_results, threads)
+
+    def search_versions(
+            self,
+            query: str,
+            versions: Sequence[str],
+            max_results: int = sys.maxsize,
+            threads: Union[int, None] = None
+    ) -> Dict[str, List[str]]:
+        """
+        Search for a passage in many versions of the Bible at once, to compare them.
+        The query is only tokenized once, and the versions are searched over native threads without holding the GIL.
+        :param query: The search query string.
+        :param versions: The versions to search.
+        :param max_results: The maximum number of results to retrieve for each version.
+        :param threads: The number of threads to search with. Defaults to one per CPU.
+        :return: The results of each version, as `search` would return them.
+        :raises InvalidVersion: If any of the versions is invalid.
+        """
+        for version in versions:
+            if version not in self.__loaded:
+                self.load(version)
+        if threads is None:
+            threads = os.cpu_count() or 1
+        return self.__c_search.search_versions(query, versions, max_results, threads)
+
+    def set_cache_size(self, cache_size: int) -> None:
+        """
+        Caps the memory used to cache the results of recent queries, evicting the least recently used ones to fit.
+        :param cache_size: Memory in bytes to cache results in, or 0 to disable the cache.
+        :return: None
+        """
+        self.__c_search.set_cache_size(cache_size)
+
+    def cache_info(self) -> Dict[str, int]:
+        """
+        Gets the counters of the result cache, to size it.
+        :return: The cache's `hits`, `misses`, `entries`, `bytes` used, and `max_bytes`.
+        """
+        return self.__c_search.cache_info()
+
     def internal_index_size(self) -> int:
         """
         Gets the size of the index stored in C in bytes.
@@ -0,0 +1,120 @@
+#ifndef BOOLEAN_H
+#define BOOLEAN_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "postings.h"
+#include "merge.h"
+#include "arena.h"
+
+/*
+ * Boolean queries: the verses with every required token and none of the excluded ones, in verse ID order.
+ * A token's verses in a version are in its lists in each of the version's tables, which never share a verse, so a
+ * term here is up to one posting iterator a table, at the least verse of them. Rather than merging every list, the
+ * required terms leapfrog each other from the rarest: a verse of the rarest is sought in the next term, and when that
+ * term lands past it, the rarest seeks on to where it landed, so that both skip (by the lists' skip tables) whatever
+ * the other doesn't have. Only the verses every required term agrees on are sought in the excluded ones.
+ */
+
+// A token of a boolean query: its lists in the tables searched, and its least verse (NO_VERSE once it's done)
+struct boolean_term
+{
+    struct posting_iterator* its;
+    int num_its;
+    size_t length;
+    uint32_t verse;
+};
+
+// Move a term on to its first verse at or after `target`, returning it (or NO_VERSE)
+static inline uint32_t term_seek(struct boolean_term* term, uint32_t target) {
+    if (term->verse >= target) {
+        return term->verse;
+    }
+    uint32_t verse = NO_VERSE;
+    for (int i = 0; i < term->num_its; i++) {
+        uint32_t next = iterator_seek(&term->its[i], target);
+        if (next < verse) {
+            verse = next;
+        }
+    }
+    term->verse = verse;
+    return verse;
+}
+
+static int compare_boolean_terms(const void* a, const void* b) {
+    size_t x = ((const struct boolean_term*) a)->length,
+           y = ((const struct boolean_term*) b)->length;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Find the verses with every required token and none of the excluded ones into `results`, up to `max_results` of
+ * them. Sources of tokens below `num_required` are required, and the rest excluded; a required token without any
+ * source has no verses, so nothing does. `results` needs room for `max_results` verses, or the length of the shortest
+ * required token if that's less.
+ * Returns the number of verses, or -1 if memory (from the arena) runs out.
+ */
+static inline Py_ssize_t boolean_postings(const struct merge_source* sources, int num_sources, int num_required,
+                                          int num_excluded, size_t max_results, uint32_t* results,
+                                          struct arena* arena) {
+    int num_terms = num_required + num_excluded;
+    if (num_required == 0 || max_results == 0) {
+        return 0;
+    }
+    struct boolean_term* terms = (struct boolean_term*) arena_calloc(arena, num_terms, sizeof(struct boolean_term));
+    struct posting_iterator* its = (struct posting_iterator*) arena_alloc(arena, (num_sources ? num_sources : 1) * sizeof(struct posting_iterator));
+    if (terms == NULL || its == NULL) {
+        return -1;
+    }
+    // Group the iterators by token
+    int n = 0;
+    for (int t = 0; t < num_terms; t++) {
+        terms[t].its = &its[n];
+        for (int s = 0; s < num_sources; s++) {
+            if (sources[s].token == t && sources[s].length) {
+                iterator_init(&its[n++], sources[s].postings, sources[s].length);
+                terms[t].num_its++;
+                terms[t].length += sources[s].length;
+            }
+        }
+        // At the least verse of its lists, or done already without any
+        terms[t].verse = NO_VERSE;
+        for (int i = 0; i < terms[t].num_its; i++) {
+            if (terms[t].its[i].verse < terms[t].verse) {
+                terms[t].verse = terms[t].its[i].verse;
+            }
+        }
+    }
+    struct boolean_term* excluded = &terms[num_required];
+    qsort(terms, num_required, sizeof(struct boolean_term), compare_boolean_terms);
+
+    size_t count = 0;
+    uint32_t verse = terms[0].verse;
+    while (verse != NO_VERSE) {
+        // Every other required term has to land on it too, or the rarest leaps to where one did
+        uint32_t next = verse;
+        for (int t = 1; t < num_required && next == verse; t++) {
+            next = term_seek(&terms[t], verse);
+        }
+        if (next != verse) {
+            verse = next == NO_VERSE ? NO_VERSE : term_seek(&terms[0], next);
+            continue;
+        }
+        int keep = 1;
+        for (int t = 0; t < num_excluded && keep; t++) {
+            keep = term_seek(&excluded[t], verse) != verse;
+        }
+        if (keep) {
+            results[count++] = verse;
+            if (count == max_results) {
+                break;
+            }
+        }
+        verse = verse + 1 < NUM_VERSES ? term_seek(&terms[0], verse + 1) : NO_VERSE;
+    }
+    return (Py_ssize_t) count;
+}
+
+#endif
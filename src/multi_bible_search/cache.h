@@ -0,0 +1,264 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "hashtable.h"
+#include "arena.h"
+
+/*
+ * Cache of ranked results, least recently used first out once it's over its memory cap.
+ * A query is keyed by its sorted tokens (so word order doesn't matter, which it doesn't to the ranking) and the tables
+ * of its version. Entries remember how many results they were searched for, so they only serve searches for at most
+ * that many, unless they have every result. It's not thread-safe on its own.
+ */
+
+// Buckets of an enabled cache to start with, doubled whenever there are more entries than buckets
+#define CACHE_INITIAL_BUCKETS 1024
+
+struct cache_entry
+{
+    // Neighbors in the least recently used order, and the next entry in the same bucket
+    struct cache_entry* newer;
+    struct cache_entry* older;
+    struct cache_entry* next;
+    uint64_t hash;
+    // The tables searched (language, version, and combined index)
+    uint8_t tables[3];
+    // Most results searched for, and how many there were
+    Py_ssize_t limit;
+    size_t num_results;
+    uint32_t* results;
+    // The sorted tokens
+    size_t key_length;
+    char key[];
+};
+
+struct result_cache
+{
+    struct cache_entry** buckets;
+    size_t num_buckets;
+    struct cache_entry* newest;
+    struct cache_entry* oldest;
+    size_t num_entries;
+    // Memory used by the entries, and how much they may use (0 to disable the cache)
+    size_t bytes;
+    size_t max_bytes;
+    uint64_t hits;
+    uint64_t misses;
+};
+
+static inline void reset_cache(struct result_cache* cache) {
+    memset(cache, 0, sizeof(struct result_cache));
+}
+
+static inline size_t cache_entry_size(const struct cache_entry* entry) {
+    return sizeof(struct cache_entry) + entry->key_length + entry->num_results * sizeof(uint32_t);
+}
+
+static inline uint64_t cache_hash(const uint8_t tables[3], const char* key, size_t key_length) {
+    uint64_t hash = hash_key(key, key_length) ^ ((uint64_t) tables[0] | (uint64_t) tables[1] << 8 | (uint64_t) tables[2] << 16);
+    return hash * 0x9e3779b97f4a7c15ull;
+}
+
+// Bucket of a hash, from its upper bits since the lower ones were multiplied last
+static inline size_t cache_bucket(const struct result_cache* cache, uint64_t hash) {
+    return (size_t) (hash >> 32) & (cache->num_buckets - 1);
+}
+
+static inline void cache_unlink(struct result_cache* cache, struct cache_entry* entry) {
+    if (entry->newer != NULL) {
+        entry->newer->older = entry->older;
+    }
+    else {
+        cache->newest = entry->older;
+    }
+    if (entry->older != NULL) {
+        entry->older->newer = entry->newer;
+    }
+    else {
+        cache->oldest = entry->newer;
+    }
+}
+
+static inline void cache_push_newest(struct result_cache* cache, struct cache_entry* entry) {
+    entry->newer = NULL;
+    entry->older = cache->newest;
+    if (cache->newest != NULL) {
+        cache->newest->newer = entry;
+    }
+    else {
+        cache->oldest = entry;
+    }
+    cache->newest = entry;
+}
+
+static inline void cache_remove(struct result_cache* cache, struct cache_entry* entry) {
+    struct cache_entry** link = &cache->buckets[cache_bucket(cache, entry->hash)];
+    while (*link != entry) {
+        link = &(*link)->next;
+    }
+    *link = entry->next;
+    cache_unlink(cache, entry);
+    cache->bytes -= cache_entry_size(entry);
+    cache->num_entries--;
+    free(entry->results);
+    free(entry);
+}
+
+// Drop every entry, keeping the counters and cap
+static inline void clear_cache(struct result_cache* cache) {
+    while (cache->oldest != NULL) {
+        cache_remove(cache, cache->oldest);
+    }
+}
+
+static inline void delete_cache(struct result_cache* cache) {
+    clear_cache(cache);
+    free(cache->buckets);
+    reset_cache(cache);
+}
+
+// Evict the least recently used entries until `bytes` more fit
+static inline void cache_make_room(struct result_cache* cache, size_t bytes) {
+    while (cache->oldest != NULL && cache->bytes + bytes > cache->max_bytes) {
+        cache_remove(cache, cache->oldest);
+    }
+}
+
+// Cap the memory the cache uses, 0 disabling it. Returns 0 on success, or -1 if memory runs out
+static inline int set_cache_size(struct result_cache* cache, size_t max_bytes) {
+    if (max_bytes == 0) {
+        uint64_t hits = cache->hits,
+                 misses = cache->misses;
+        delete_cache(cache);
+        cache->hits = hits;
+        cache->misses = misses;
+        return 0;
+    }
+    if (cache->buckets == NULL) {
+        cache->buckets = (struct cache_entry**) calloc(CACHE_INITIAL_BUCKETS, sizeof(struct cache_entry*));
+        if (cache->buckets == NULL) {
+            return -1;
+        }
+        cache->num_buckets = CACHE_INITIAL_BUCKETS;
+    }
+    cache->max_bytes = max_bytes;
+    cache_make_room(cache, 0);
+    return 0;
+}
+
+static inline struct cache_entry* cache_find_entry(const struct result_cache* cache, uint64_t hash,
+                                                   const uint8_t tables[3], const char* key, size_t key_length) {
+    for (struct cache_entry* entry = cache->buckets[cache_bucket(cache, hash)]; entry != NULL; entry = entry->next) {
+        if (entry->hash == hash && entry->key_length == key_length && !memcmp(entry->tables, tables, 3) &&
+            !memcmp(entry->key, key, key_length)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Look up the first `max_results` results of a query, copying them to `*results` in the arena.
+ * Returns their number, or -1 if they aren't cached (or memory runs out).
+ */
+static inline Py_ssize_t cache_lookup(struct result_cache* cache, const uint8_t tables[3], const char* key,
+                                      size_t key_length, Py_ssize_t max_results, uint32_t** results,
+                                      struct arena* arena) {
+    uint64_t hash = cache_hash(tables, key, key_length);
+    struct cache_entry* entry = cache_find_entry(cache, hash, tables, key, key_length);
+    // Searched for fewer results than there are, and fewer than these
+    if (entry == NULL || ((Py_ssize_t) entry->num_results == entry->limit && max_results > entry->limit)) {
+        cache->misses++;
+        return -1;
+    }
+    size_t count = (size_t) max_results < entry->num_results ? (size_t) max_results : entry->num_results;
+    *results = (uint32_t*) arena_alloc(arena, count * sizeof(uint32_t));
+    if (*results == NULL) {
+        return -1;
+    }
+    memcpy(*results, entry->results, count * sizeof(uint32_t));
+    cache_unlink(cache, entry);
+    cache_push_newest(cache, entry);
+    cache->hits++;
+    return (Py_ssize_t) count;
+}
+
+// Double the buckets, keeping the old ones if memory runs out
+static inline void cache_grow(struct result_cache* cache) {
+    size_t num_buckets = cache->num_buckets * 2;
+    struct cache_entry** buckets = (struct cache_entry**) calloc(num_buckets, sizeof(struct cache_entry*));
+    if (buckets == NULL) {
+        return;
+    }
+    free(cache->buckets);
+    cache->buckets = buckets;
+    cache->num_buckets = num_buckets;
+    for (struct cache_entry* entry = cache->oldest; entry != NULL; entry = entry->newer) {
+        size_t bucket = cache_bucket(cache, entry->hash);
+        entry->next = buckets[bucket];
+        buckets[bucket] = entry;
+    }
+}
+
+// Cache the results of a query searched for `limit` of them, as long as they fit. Best effort
+static inline void cache_insert(struct result_cache* cache, const uint8_t tables[3], const char* key,
+                                size_t key_length, Py_ssize_t limit, const uint32_t* results, size_t num_results) {
+    uint64_t hash = cache_hash(tables, key, key_length);
+    struct cache_entry* entry = cache_find_entry(cache, hash, tables, key, key_length);
+    if (entry != NULL) {
+        // Another search got there first, with at least as many
+        if (entry->limit >= limit) {
+            return;
+        }
+        cache_remove(cache, entry);
+    }
+    size_t size = sizeof(struct cache_entry) + key_length + num_results * sizeof(uint32_t);
+    if (size > cache->max_bytes) {
+        return;
+    }
+    cache_make_room(cache, size);
+
+    entry = (struct cache_entry*) malloc(sizeof(struct cache_entry) + key_length);
+    if (entry == NULL) {
+        return;
+    }
+    entry->results = (uint32_t*) malloc((num_results ? num_results : 1) * sizeof(uint32_t));
+    if (entry->results == NULL) {
+        free(entry);
+        return;
+    }
+    memcpy(entry->results, results, num_results * sizeof(uint32_t));
+    memcpy(entry->tables, tables, 3);
+    memcpy(entry->key, key, key_length);
+    entry->hash = hash;
+    entry->limit = limit;
+    entry->num_results = num_results;
+    entry->key_length = key_length;
+
+    size_t bucket = cache_bucket(cache, hash);
+    entry->next = cache->buckets[bucket];
+    cache->buckets[bucket] = entry;
+    cache_push_newest(cache, entry);
+    cache->bytes += size;
+    if (++cache->num_entries > cache->num_buckets) {
+        cache_grow(cache);
+    }
+}
+
+// Drop the entries of every version that searches `table`, as its contents changed
+static inline void cache_invalidate_table(struct result_cache* cache, uint8_t table) {
+    struct cache_entry* entry = cache->oldest;
+    while (entry != NULL) {
+        struct cache_entry* newer = entry->newer;
+        if (entry->tables[0] == table || entry->tables[1] == table || entry->tables[2] == table) {
+            cache_remove(cache, entry);
+        }
+        entry = newer;
+    }
+}
+
+#endif
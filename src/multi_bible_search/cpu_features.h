@@ -0,0 +1,113 @@
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Runtime CPU feature detection, so that generic builds can still use SIMD kernels where the CPU has them.
+ *
+ * Kernels are compiled for their instruction set with TARGET_SSE2/TARGET_SSSE3/TARGET_SSE42/TARGET_AVX2 regardless of
+ * the flags the module is built with, and only called (through a function pointer picked at import) if the CPU supports
+ * it.
+ * CPU_X86_SIMD is only defined where that is possible.
+ */
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define CPU_X86_SIMD 1
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_SSE42 __attribute__((target("sse4.2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#elif defined(_M_X64) || defined(_M_IX86)
+// MSVC allows any intrinsic in any function
+#define CPU_X86_SIMD 1
+#define TARGET_SSE2
+#define TARGET_SSSE3
+#define TARGET_SSE42
+#define TARGET_AVX2
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+// Instruction sets the kernels can use
+#define CPU_SSSE3 1
+#define CPU_SSE42 2
+#define CPU_AVX2 4
+#define CPU_SSE2 8
+
+// Set to 0 (scalar only) or any of the CPU_* flags to override detection, e.g., for benchmarks and tests
+static int cpu_feature_mask = -1;
+
+/*
+ * Environment variable capping the instruction sets used to one of "scalar", "sse2", "ssse3", "sse4.2" or "avx2" (and
+ * the ones before it), so that a process can run the fallback kernels on any CPU. Read when the kernels are picked, at
+ * import.
+ */
+#define CPU_FEATURES_ENV "MULTI_BIBLE_SEARCH_SIMD"
+
+// Get the CPU_* flags the environment allows, or -1 for all of them
+static inline int cpu_features_allowed(void) {
+    static const char* const levels[] = {"scalar", "sse2", "ssse3", "sse4.2", "avx2"};
+    static const int masks[] = {
+        0,
+        CPU_SSE2,
+        CPU_SSE2 | CPU_SSSE3,
+        CPU_SSE2 | CPU_SSSE3 | CPU_SSE42,
+        CPU_SSE2 | CPU_SSSE3 | CPU_SSE42 | CPU_AVX2,
+    };
+    const char* level = getenv(CPU_FEATURES_ENV);
+    if (level == NULL) {
+        return -1;
+    }
+    for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); i++) {
+        if (!strcmp(level, levels[i])) {
+            return masks[i];
+        }
+    }
+    return -1;
+}
+
+// Get the CPU_* flags of the instruction sets this CPU (and OS) supports
+static inline int cpu_features(void) {
+    int features = 0;
+#if defined(CPU_X86_SIMD) && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        features |= CPU_SSE2;
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        features |= CPU_SSSE3;
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        features |= CPU_SSE42;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        features |= CPU_AVX2;
+    }
+#elif defined(CPU_X86_SIMD)
+    int info[4];
+    __cpuid(info, 0);
+    int max_leaf = info[0];
+    __cpuid(info, 1);
+    if (info[3] & (1 << 26)) {
+        features |= CPU_SSE2;
+    }
+    if (info[2] & (1 << 9)) {
+        features |= CPU_SSSE3;
+    }
+    if (info[2] & (1 << 20)) {
+        features |= CPU_SSE42;
+    }
+    // AVX2 also needs the OS to save the YMM registers (OSXSAVE, then XCR0 bits 1 and 2)
+    if (max_leaf >= 7 && (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6) {
+        __cpuidex(info, 7, 0);
+        if (info[1] & (1 << 5)) {
+            features |= CPU_AVX2;
+        }
+    }
+#endif
+    return features & cpu_feature_mask & cpu_features_allowed();
+}
+
+#endif
@@ -0,0 +1,243 @@
+#ifndef DICTIONARY_H
+#define DICTIONARY_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hashtable.h"
+
+/*
+ * Every table shares one term dictionary, which gives each distinct key a dense term ID: the index of its element in
+ * the dictionary (a hashtable whose elements' offsets and lengths are unused). A query token is hashed once, and the
+ * posting lists of the tables it searches are then found by term ID.
+ *
+ * Tables are loaded into a hashtable first, then installed: their keys are added to the dictionary and they're
+ * turned into a term_table, which only holds the posting lists of its terms, and its terms in key order, so that the
+ * terms starting with a prefix are a range found by binary search. Each install settles the dictionary again (see
+ * settle_table), so that searches find a token with a perfect hash lookup and one key comparison.
+ */
+
+// Term ID of a key that isn't in the dictionary
+#define NO_TERM UINT32_MAX
+
+// Where a term's posting list is in a table's postings
+struct posting_list
+{
+    uint32_t offset;
+    uint32_t length;
+};
+
+// struct representing a loaded table, searchable by term ID
+struct term_table
+{
+    // Index of each term's posting list in `lists` plus one, or 0 for terms the table doesn't have.
+    // Terms added to the dictionary after the table was installed are past the end, so they aren't in it either
+    uint32_t* terms;
+    uint32_t num_terms;
+    struct posting_list* lists;
+    uint32_t num_lists;
+    // Term ID of each of the `num_lists` terms of the table, sorted by key
+    uint32_t* sorted_terms;
+    // Every posting list of the table, encoded back to back (see postings.h)
+    uint8_t* postings;
+    size_t postings_size;
+    // For tables served from an index file, the file backing the postings
+    struct mapped_file mapping;
+};
+
+// Get the term ID of a key, or NO_TERM if no table has it
+static inline uint32_t find_term(const struct hashtable* dictionary, const char* key) {
+    const struct element* e = get_element(dictionary, key);
+    return e != NULL ? (uint32_t) (e - dictionary->elements) : NO_TERM;
+}
+
+// Get the term ID of a key already hashed with hash_key, or NO_TERM if no table has it
+static inline uint32_t find_term_hashed(const struct hashtable* dictionary, const char* key, uint64_t key_hash) {
+    const struct element* e = get_element_hashed(dictionary, key, key_hash);
+    return e != NULL ? (uint32_t) (e - dictionary->elements) : NO_TERM;
+}
+
+// Get the term ID of a key, adding it to the dictionary if need be. Returns NO_TERM if memory runs out
+static inline uint32_t add_term(struct hashtable* dictionary, const char* key) {
+    const struct element* e = add_element(dictionary, key, 0, 0);
+    return e != NULL ? (uint32_t) (e - dictionary->elements) : NO_TERM;
+}
+
+// Zero out a table's attributes so that it reads as empty
+static inline void reset_term_table(struct term_table* table) {
+    table->terms = NULL;
+    table->num_terms = 0;
+    table->lists = NULL;
+    table->num_lists = 0;
+    table->sorted_terms = NULL;
+    table->postings = NULL;
+    table->postings_size = 0;
+    table->mapping.data = NULL;
+    table->mapping.size = 0;
+}
+
+// Whether anything has been installed into a table
+static inline int term_table_loaded(const struct term_table* table) {
+    return table->terms != NULL;
+}
+
+// Free the dynamically allocated memory for the given table, but not the bare table itself
+static inline void delete_term_table(struct term_table* table) {
+    if (table == NULL) {
+        return;
+    }
+    free(table->terms);
+    free(table->lists);
+    free(table->sorted_terms);
+    // The postings of tables loaded from an index file belong to the mapping
+    if (table->mapping.data != NULL) {
+        unmap_file(&table->mapping);
+    }
+    else {
+        free(table->postings);
+    }
+}
+
+// Get the posting list of a term in a table, or NULL if the table doesn't have it
+static inline const struct posting_list* get_posting_list(const struct term_table* table, uint32_t term) {
+    if (term >= table->num_terms || !table->terms[term]) {
+        return NULL;
+    }
+    return &table->lists[table->terms[term] - 1];
+}
+
+// Get the encoded references of a posting list of a table
+static inline const uint8_t* get_list_postings(const struct term_table* table, const struct posting_list* list) {
+    return table->postings + list->offset;
+}
+
+// A key and its term ID, to sort a table's terms by key
+struct sorted_term
+{
+    const char* key;
+    uint32_t term;
+};
+
+static int compare_sorted_terms(const void* a, const void* b) {
+    return strcmp(((const struct sorted_term*) a)->key, ((const struct sorted_term*) b)->key);
+}
+
+/*
+ * Fill in a table's terms in key order from the IDs of the hashtable's elements.
+ * Returns 0 on success, or -1 if memory runs out.
+ */
+static inline int sort_table_terms(const struct hashtable* ht, const uint32_t* ids, struct term_table* table) {
+    size_t count = ht->num_elements;
+    struct sorted_term* order = (struct sorted_term*) malloc((count ? count : 1) * sizeof(struct sorted_term));
+    if (order == NULL) {
+        return -1;
+    }
+    int sorted = 1;
+    for (size_t i = 0; i < count; i++) {
+        order[i] = (struct sorted_term) {ht->elements[i].key, ids[i]};
+        sorted = sorted && (i == 0 || strcmp(order[i - 1].key, order[i].key) < 0);
+    }
+    // Index files are in key order already
+    if (!sorted) {
+        qsort(order, count, sizeof(struct sorted_term), compare_sorted_terms);
+    }
+    for (size_t i = 0; i < count; i++) {
+        table->sorted_terms[i] = order[i].term;
+    }
+    free(order);
+    return 0;
+}
+
+// Whether the key of a term, cut to `length` characters, sorts before, with, or after a prefix (like strncmp)
+static inline int compare_prefix(const struct hashtable* dictionary, uint32_t term, const char* prefix, uint32_t length) {
+    return strncmp(dictionary->elements[term].key, prefix, length);
+}
+
+/*
+ * Find the range of a table's sorted terms that start with a prefix of `length` characters, [*first, *last), with two
+ * binary searches.
+ */
+static inline void find_prefix_range(const struct term_table* table, const struct hashtable* dictionary,
+                                     const char* prefix, uint32_t length, uint32_t* first, uint32_t* last) {
+    uint32_t low = 0,
+             high = table->num_lists;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (compare_prefix(dictionary, table->sorted_terms[middle], prefix, length) < 0) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    *first = low;
+    high = table->num_lists;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (compare_prefix(dictionary, table->sorted_terms[middle], prefix, length) <= 0) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    *last = low;
+}
+
+/*
+ * Install a loaded hashtable into an empty term table, adding its keys to the dictionary.
+ * On success the term table takes over the postings (and any mapping), the hashtable is deleted, and the dictionary
+ * is settled.
+ * Returns 0 on success, or -1 if memory runs out, in which case the hashtable is left as it was.
+ */
+static inline int install_table(struct hashtable* dictionary, struct hashtable* ht, struct term_table* table) {
+    uint32_t* ids = (uint32_t*) malloc((ht->num_elements ? ht->num_elements : 1) * sizeof(uint32_t));
+    if (ids == NULL) {
+        return -1;
+    }
+    for (size_t i = 0; i < ht->num_elements; i++) {
+        ids[i] = add_term(dictionary, ht->elements[i].key);
+        if (ids[i] == NO_TERM) {
+            free(ids);
+            return -1;
+        }
+    }
+
+    // Only now is the number of term IDs known
+    uint32_t num_terms = (uint32_t) dictionary->num_elements;
+    table->terms = (uint32_t*) calloc(num_terms ? num_terms : 1, sizeof(uint32_t));
+    table->lists = (struct posting_list*) malloc((ht->num_elements ? ht->num_elements : 1) * sizeof(struct posting_list));
+    table->sorted_terms = (uint32_t*) malloc((ht->num_elements ? ht->num_elements : 1) * sizeof(uint32_t));
+    if (table->terms == NULL || table->lists == NULL || table->sorted_terms == NULL ||
+        sort_table_terms(ht, ids, table)) {
+        free(ids);
+        free(table->terms);
+        free(table->lists);
+        free(table->sorted_terms);
+        reset_term_table(table);
+        return -1;
+    }
+    for (size_t i = 0; i < ht->num_elements; i++) {
+        table->terms[ids[i]] = (uint32_t) i + 1;
+        table->lists[i].offset = ht->elements[i].offset;
+        table->lists[i].length = ht->elements[i].length;
+    }
+    free(ids);
+    table->num_terms = num_terms;
+    table->num_lists = (uint32_t) ht->num_elements;
+
+    // Hand over the postings, and free everything else
+    table->postings = ht->postings;
+    table->postings_size = ht->postings_size;
+    table->mapping = ht->mapping;
+    free(ht->slots);
+    if (ht->mapping.data == NULL) {
+        free(ht->elements);
+    }
+    reset_table(ht);
+    // Its slots are kept if this fails, so lookups work either way
+    settle_table(dictionary);
+    return 0;
+}
+
+#endif
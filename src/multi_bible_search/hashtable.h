@@ -5,151 +5,319 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include "mapped_file.h"
+#include "postings.h"
+#include "perfect_hash.h"
 
-// How much to increase the size of the hash table by each time
-#define INCREMENT_SIZE 100
+// The max load of the table before it doubles in size
+#define MAX_LOAD 0.75
 
-// The max load of the table before reallocation
-#define MAX_LOAD 0.8
+// Number of slots of a table created without knowing how many elements it will hold
+#define INITIAL_SIZE 1024
 
-// struct representing an element of the hash table
+// Width of the key of an element, including the null terminator
+#define KEY_SIZE 24
+
+// struct representing an element of the hash table. This is also the layout of a term in an index file
 struct element
 {
-    char key[22];
-    uint32_t* value;
+    char key[KEY_SIZE];
+    // Byte offset of the element's encoded posting list in the table's postings
+    uint32_t offset;
+    // Number of references in the posting list
     uint32_t length;
 };
 
+/*
+ * A slot of the open-addressed table. The tag is the upper half of the key's hash, so a probe only looks at an
+ * element's key when the tags match, and eight slots share a cache line.
+ */
+struct slot
+{
+    uint32_t tag;
+    // Index of the element plus one, so that 0 marks an empty slot
+    uint32_t entry;
+};
+
 // struct representing the overall hash table
 struct hashtable
 {
-    struct element** elements;
+    // Power of two number of slots, linearly probed
+    struct slot* slots;
     size_t size;
+    // The elements themselves, stored contiguously in insertion order
+    struct element* elements;
     size_t num_elements;
+    size_t elements_capacity;
+    // Once a table is settled, its keys are looked up through this instead of the slots, which are dropped
+    struct perfect_hash lookup;
+    // Every posting list of the table, encoded back to back (see postings.h)
+    uint8_t* postings;
+    size_t postings_size;
+    size_t postings_capacity;
+    // For tables served from an index file, the file backing the elements and postings
+    struct mapped_file mapping;
 };
 
-// Calculate the hash of a string based on the size of the hash table
-static inline size_t hash(const char* key, const size_t size) {
-    size_t length = strlen(key);
-    uint32_t result = (uint32_t)(key[0] << 7);
+// Hash of a key, a byte at a time: FNV-1a from HASH_SEED, then mixed so that every bit depends on every byte
+#define HASH_SEED 14695981039346656037ull
+
+static inline uint64_t hash_step(uint64_t hash, uint8_t byte) {
+    return (hash ^ byte) * 1099511628211ull;
+}
+
+static inline uint64_t hash_finish(uint64_t hash) {
+    hash ^= hash >> 32;
+    hash *= 0xd6e8feb86659fd93ull;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+// Calculate the 64-bit hash of a key of `length` characters
+static inline uint64_t hash_key(const char* key, size_t length) {
+    uint64_t result = HASH_SEED;
     for (size_t i = 0; i < length; i++) {
-        result = (uint32_t)((1003u * result) ^ (uint8_t)key[i]);
+        result = hash_step(result, (uint8_t) key[i]);
     }
-    result += result >> 1;
-    result ^= ~length;
-    return (size_t)(result % size);
+    return hash_finish(result);
 }
 
-// Allocate space for a new or larger hash table
-static inline void allocate_table(struct hashtable* ht) {
-    // If the table is empty, create a brand new one
-    if (ht->size == 0) {
-        // We'll start with a table of INCREMENT_SIZE
-        ht->elements = (struct element**) calloc(INCREMENT_SIZE, sizeof(struct element *));
-        ht->num_elements = 0;
-        ht->size = INCREMENT_SIZE;
-        return;
+// Put the element at `index` into the first free slot for its hash. The table must have room for it
+static inline void place_element(struct hashtable* ht, uint32_t index, uint64_t key_hash) {
+    size_t mask = ht->size - 1;
+    size_t j = (size_t) key_hash & mask;
+    while (ht->slots[j].entry) {
+        j = (j + 1) & mask;
     }
-    else {
-        size_t new_size = ht->size + INCREMENT_SIZE;   // The size of the new hash table
-        size_t new_hash, i, j;
-
-        // Make a new array of elements and store the pointer to the old one
-        struct element **new_elements = (struct element**) calloc(new_size, sizeof(struct element *));
-        struct element **old_elements = ht->elements;
-
-        // Copy the old hash table into the new one
-        for (i = 0; i < ht->size; i++) {
-            if (ht->elements[i]) {
-                // Find a spot for the old element in the new table
-                new_hash = hash(ht->elements[i]->key, new_size);
-                j = new_hash;
-                while (new_elements[j] != NULL)
-                {
-                    j++;
-                    if (j >= new_size) {
-                        j = 0;
-                    }
-                }
-                new_elements[j] = old_elements[i];
-            }
+    ht->slots[j].tag = (uint32_t) (key_hash >> 32);
+    ht->slots[j].entry = index + 1;
+}
+
+// Replace the table's slots with `size` empty ones and place every element again. Returns 0 on success, -1 otherwise
+static inline int resize_slots(struct hashtable* ht, size_t size) {
+    struct slot* slots = (struct slot*) calloc(size, sizeof(struct slot));
+    if (slots == NULL) {
+        return -1;
+    }
+    free(ht->slots);
+    ht->slots = slots;
+    ht->size = size;
+    for (size_t i = 0; i < ht->num_elements; i++) {
+        const char* key = ht->elements[i].key;
+        place_element(ht, (uint32_t) i, hash_key(key, strlen(key)));
+    }
+    return 0;
+}
+
+// Number of slots needed to hold `count` elements without growing
+static inline size_t table_size_for(size_t count) {
+    size_t size = 16;
+    while (size * MAX_LOAD < count + 1) {
+        size *= 2;
+    }
+    return size;
+}
+
+/*
+ * Allocate the slots of an empty table, sized once for `count` elements.
+ * Returns 0 on success, -1 if memory runs out.
+ */
+static inline int reserve_table(struct hashtable* ht, size_t count) {
+    ht->num_elements = 0;
+    return resize_slots(ht, table_size_for(count));
+}
+
+// Zero out a table's attributes so that it reads as empty
+static inline void reset_table(struct hashtable* ht) {
+    ht->slots = NULL;
+    ht->size = 0;
+    ht->elements = NULL;
+    ht->num_elements = 0;
+    ht->elements_capacity = 0;
+    memset(&ht->lookup, 0, sizeof(ht->lookup));
+    ht->postings = NULL;
+    ht->postings_size = 0;
+    ht->postings_capacity = 0;
+    ht->mapping.data = NULL;
+    ht->mapping.size = 0;
+}
+
+// Whether anything has been loaded into a table
+static inline int table_loaded(const struct hashtable* ht) {
+    return ht->elements != NULL;
+}
+
+// Get the encoded posting list of an element of the table
+static inline const uint8_t* get_postings(const struct hashtable* ht, const struct element* e) {
+    return ht->postings + e->offset;
+}
+
+/*
+ * Encode a sorted list of references onto the end of the table's postings.
+ * Returns 0 on success and stores the list's offset, or -1 if memory runs out.
+ */
+static inline int append_postings(struct hashtable* ht, const uint32_t* values, uint32_t count, uint32_t* offset) {
+    // Always keep room for the padding decoders may read into
+    size_t needed = ht->postings_size + max_encoded_postings(count) + POSTING_PADDING;
+    if (needed > ht->postings_capacity) {
+        size_t new_capacity = ht->postings_capacity ? ht->postings_capacity * 2 : 64 * 1024;
+        while (new_capacity < needed) {
+            new_capacity *= 2;
         }
-        // Free the memory of the old elements and store the location of the new array
-        ht->elements = new_elements;
-        free(old_elements);
-        ht->size = new_size;
+        uint8_t* new_postings = (uint8_t*) realloc(ht->postings, new_capacity);
+        if (new_postings == NULL) {
+            return -1;
+        }
+        ht->postings = new_postings;
+        ht->postings_capacity = new_capacity;
     }
+    *offset = (uint32_t) ht->postings_size;
+    ht->postings_size += encode_postings(values, count, ht->postings + ht->postings_size);
+    memset(ht->postings + ht->postings_size, 0, POSTING_PADDING);
+    return 0;
 }
 
 // Free the dynamically allocated memory for the given hash table, but not the bare table itself
 void delete_table(struct hashtable* ht) {
-    // If the table is empty, there's nothing to deallocate
-    if (ht == NULL || !ht->size) { 
+    if (ht == NULL) { 
         return; 
     }
+    free(ht->slots);
+    free_perfect_hash(&ht->lookup);
 
-    // Otherwise, delete everything
-    for (size_t i = 0; i < ht->size; i++) {
-        // Can't free NULL
-        if (ht->elements[i] != NULL) {
-            free(ht->elements[i]->value);
-            free(ht->elements[i]);
-        }
+    // The elements and postings of tables loaded from an index file belong to the mapping
+    if (ht->mapping.data != NULL) {
+        unmap_file(&ht->mapping);
+        return;
     }
     free(ht->elements);
+    free(ht->postings);
 }
 
-// Add an element to the hash table
-void add_element(struct hashtable* ht, struct element* e) {
-    // If the table is too small, expand it
+// Get the element with the given key and hash, or NULL if there isn't one
+static inline struct element* get_element_hashed(const struct hashtable* ht, const char* key, uint64_t key_hash) {
+    // The only element this key could be
+    if (ht->lookup.pilots != NULL) {
+        struct element* e = &ht->elements[perfect_hash_lookup(&ht->lookup, key_hash)];
+        return strcmp(e->key, key) ? NULL : e;
+    }
+    // Nothing is loaded
     if (!ht->size) {
-        allocate_table(ht);
+        return NULL;
     }
-    else if (ht->size * MAX_LOAD <= ht->num_elements) {
-        allocate_table(ht);
+    size_t mask = ht->size - 1;
+    size_t j = (size_t) key_hash & mask;
+    uint32_t tag = (uint32_t) (key_hash >> 32);
+    // Search for the element. If the element does not exist, that is fine
+    while (ht->slots[j].entry) {
+        if (ht->slots[j].tag == tag) {
+            struct element* e = &ht->elements[ht->slots[j].entry - 1];
+            if (!strcmp(e->key, key)) {
+                return e;
+            }
+        }
+        j = (j + 1) & mask;
     }
-    
-    // Hash the element and see if we can just put it in the first spot
-    size_t element_hash = hash(e->key, ht->size);
-    if (ht->elements[element_hash] == NULL) {
-        ht->elements[element_hash] = e;
-        ht->num_elements++;
-        return;
+    return NULL;
+}
+
+// Get an element of the hash table
+static inline struct element* get_element(const struct hashtable* ht, const char* key) {
+    return get_element_hashed(ht, key, hash_key(key, strlen(key)));
+}
+
+/*
+ * Add an element with the given key and posting list to a table that owns its elements.
+ * A key that is already present has its posting list replaced.
+ * Returns the element, or NULL if memory runs out.
+ */
+static inline struct element* add_element(struct hashtable* ht, const char* key, uint32_t offset, uint32_t length) {
+    size_t key_length = strlen(key);
+    if (key_length >= KEY_SIZE) {
+        return NULL;
+    }
+    uint64_t key_hash = hash_key(key, key_length);
+    struct element* existing = get_element_hashed(ht, key, key_hash);
+    if (existing != NULL) {
+        existing->offset = offset;
+        existing->length = length;
+        return existing;
     }
-    // Check if this element happens to be a duplicate. Probably could remove this
-    if (!strcmp(ht->elements[element_hash]->key, e->key)) {
-        free(ht->elements[element_hash]->value);
-        free(ht->elements[element_hash]);
-        allocate_table(ht);
-        element_hash = hash(e->key, ht->size);
-        ht->elements[element_hash] = e;
-    }
-    // Since there was a collision, perform a linear search to find the next open spot
-    size_t j = element_hash;
-    while (ht->elements[j] != NULL)
-    {
-        j++;
-        if (j == ht->size) {
-            j = 0;
+    // The table is changing, so go back to the slots until it's settled again
+    if (ht->lookup.pilots != NULL) {
+        if (resize_slots(ht, table_size_for(ht->num_elements + 1))) {
+            return NULL;
         }
+        free_perfect_hash(&ht->lookup);
     }
-    // Add a reference to the element and increment the count of elements
-    ht->elements[j] = e;
+
+    // Double the slots if the table is too full (or create them if there are none yet)
+    if (!ht->size || ht->size * MAX_LOAD < ht->num_elements + 1) {
+        if (resize_slots(ht, ht->size ? ht->size * 2 : INITIAL_SIZE)) {
+            return NULL;
+        }
+    }
+    if (ht->num_elements == ht->elements_capacity) {
+        size_t new_capacity = ht->elements_capacity ? ht->elements_capacity * 2 : (size_t) (ht->size * MAX_LOAD);
+        struct element* new_elements = (struct element*) realloc(ht->elements, new_capacity * sizeof(struct element));
+        if (new_elements == NULL) {
+            return NULL;
+        }
+        ht->elements = new_elements;
+        ht->elements_capacity = new_capacity;
+    }
+
+    // Keys are zero padded, so that elements can be written out as-is
+    struct element* e = &ht->elements[ht->num_elements];
+    memset(e->key, 0, KEY_SIZE);
+    memcpy(e->key, key, key_length);
+    e->offset = offset;
+    e->length = length;
+    place_element(ht, (uint32_t) ht->num_elements, key_hash);
     ht->num_elements++;
+    return e;
 }
 
-// Get an element of the hash table
-static inline struct element* get_element(const struct hashtable* ht, const char * key) {
-    size_t j = hash(key, ht->size);
-    // Search for the element. If the element does not exist, that is fine
-    while (ht->elements[j] != NULL && strcmp(ht->elements[j]->key, key)) {
-        j++;
-        if (j == ht->size) {
-            j = 0;
-        }
+/*
+ * Settle a table whose keys are done changing for now: look them up through a minimal perfect hash, sized to the
+ * number of keys, and drop the slots. Adding a key later goes back to the slots. If the perfect hash can't be built,
+ * the slots stay. Returns 0 once it's built, or -1 otherwise.
+ */
+static inline int settle_table(struct hashtable* ht) {
+    if (ht->lookup.pilots != NULL) {
+        return 0;
+    }
+    if (ht->num_elements == 0) {
+        return -1;
+    }
+    uint64_t* hashes = (uint64_t*) malloc(ht->num_elements * sizeof(uint64_t));
+    if (hashes == NULL) {
+        return -1;
+    }
+    for (size_t i = 0; i < ht->num_elements; i++) {
+        hashes[i] = hash_key(ht->elements[i].key, strlen(ht->elements[i].key));
+    }
+    int error = build_perfect_hash(&ht->lookup, hashes, (uint32_t) ht->num_elements);
+    free(hashes);
+    if (error) {
+        return -1;
+    }
+    free(ht->slots);
+    ht->slots = NULL;
+    ht->size = 0;
+    return 0;
+}
+
+// Give back the unused part of a table's postings once it is done loading
+static inline void shrink_postings(struct hashtable* ht) {
+    if (ht->mapping.data != NULL || ht->postings == NULL) {
+        return;
+    }
+    uint8_t* new_postings = (uint8_t*) realloc(ht->postings, ht->postings_size + POSTING_PADDING);
+    if (new_postings != NULL) {
+        ht->postings = new_postings;
+        ht->postings_capacity = ht->postings_size + POSTING_PADDING;
     }
-    // This returns either the element or NULL
-    return ht->elements[j];
 }
 
 #endif
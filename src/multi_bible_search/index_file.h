@@ -0,0 +1,224 @@
+#ifndef INDEX_FILE_H
+#define INDEX_FILE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "hashtable.h"
+#include "dictionary.h"
+#include "mapped_file.h"
+#include "verses.h"
+
+/*
+ * Binary index format. Everything is little-endian and laid out so that the file can be mapped and used as-is:
+ *
+ *   struct index_header      (32 bytes)
+ *   struct element[]         (num_terms, sorted by key, with offsets into the postings)
+ *   uint8_t postings[]       (postings_size bytes of encoded posting lists of verse IDs, see postings.h)
+ *   POSTING_PADDING zero bytes
+ */
+#define INDEX_MAGIC "MBSI"
+// Bump this whenever the layout changes. Older files are rejected and rebuilt by the adapter
+#define INDEX_FORMAT_VERSION 5
+
+// Load/save results
+#define INDEX_OK 0
+#define INDEX_IO_ERROR 1
+#define INDEX_BAD_FORMAT 2
+#define INDEX_BAD_VERSION 3
+#define INDEX_ALLOC_ERROR 4
+#define INDEX_UNSUPPORTED 5
+#define INDEX_NO_BZIP2 6
+
+struct index_header
+{
+    char magic[4];
+    uint32_t format_version;
+    uint32_t num_terms;
+    // Total number of references in all of the posting lists
+    uint32_t num_postings;
+    // Byte offsets of the term dictionary and postings from the start of the file
+    uint32_t terms_offset;
+    uint32_t postings_offset;
+    // Size of the encoded postings in bytes, not counting the padding
+    uint32_t postings_size;
+    // Number of verses of the versification its verse IDs are from
+    uint32_t num_verses;
+};
+
+// The format is little-endian, so it can only be served directly on little-endian machines
+static inline int host_is_little_endian(void) {
+    const uint16_t probe = 1;
+    return *(const uint8_t*) &probe;
+}
+
+// Get a readable message for a load/save result
+static inline const char* index_error_string(int error) {
+    switch (error) {
+        case INDEX_OK:
+            return "Success";
+        case INDEX_IO_ERROR:
+            return "Unable to read or write the index file";
+        case INDEX_BAD_FORMAT:
+            return "Malformed index file";
+        case INDEX_BAD_VERSION:
+            return "Unsupported index format version";
+        case INDEX_ALLOC_ERROR:
+            return "Memory allocation failure while loading index";
+        case INDEX_NO_BZIP2:
+            return "This module was built without bzip2 support";
+        default:
+            return "Index files are not supported on this platform";
+    }
+}
+
+/*
+ * Serve an empty table from an index file, ready to be installed.
+ * The term dictionary and postings are used in place, so nothing is allocated.
+ */
+static inline int load_index_file(const char* path, struct hashtable* ht) {
+    if (!host_is_little_endian()) {
+        return INDEX_UNSUPPORTED;
+    }
+    struct mapped_file mf;
+    if (map_file(path, &mf)) {
+        return INDEX_IO_ERROR;
+    }
+    int error = INDEX_BAD_FORMAT;
+    if (mf.size < sizeof(struct index_header)) {
+        goto fail;
+    }
+
+    const struct index_header* header = (const struct index_header*) mf.data;
+    if (memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic))) {
+        goto fail;
+    }
+    if (header->format_version != INDEX_FORMAT_VERSION || header->num_verses != NUM_VERSES) {
+        error = INDEX_BAD_VERSION;
+        goto fail;
+    }
+    // Bounds check the sections against the file before touching them
+    if ((uint64_t) header->terms_offset + (uint64_t) header->num_terms * sizeof(struct element) > mf.size ||
+        (uint64_t) header->postings_offset + header->postings_size + POSTING_PADDING > mf.size ||
+        header->terms_offset % sizeof(uint32_t)) {
+        goto fail;
+    }
+
+    // The elements are used straight out of the file
+    struct element* terms = (struct element*) (mf.data + header->terms_offset);
+    const uint8_t* postings = (const uint8_t*) (mf.data + header->postings_offset);
+    uint32_t num_terms = header->num_terms;
+    for (uint32_t i = 0; i < num_terms; i++) {
+        const struct element* term = &terms[i];
+        // Strictly increasing keys also rule out duplicates, and lists are stored in the same order as the terms
+        if (memchr(term->key, '\0', KEY_SIZE) == NULL ||
+            term->offset > header->postings_size ||
+            (i && (strcmp(terms[i - 1].key, term->key) >= 0 || term->offset < terms[i - 1].offset))) {
+            goto fail;
+        }
+    }
+    // Searches trust the lists to stay within their own storage and hold verse IDs, so check each one in full
+    for (uint32_t i = 0; i < num_terms; i++) {
+        uint32_t end = i + 1 < num_terms ? terms[i + 1].offset : header->postings_size;
+        if (!valid_postings(postings + terms[i].offset, terms[i].length, end - terms[i].offset)) {
+            goto fail;
+        }
+    }
+    ht->elements = terms;
+    ht->num_elements = num_terms;
+
+    ht->postings = (uint8_t*) postings;
+    ht->postings_size = header->postings_size;
+    ht->mapping = mf;
+    return INDEX_OK;
+
+fail:
+    unmap_file(&mf);
+    return error;
+}
+
+// Comparison function for sorting elements by key
+static int compare_elements(const void* a, const void* b) {
+    return strcmp((*(const struct element* const*) a)->key, (*(const struct element* const*) b)->key);
+}
+
+// Write an installed table to `path` as an index file, with its keys from the dictionary
+static inline int save_index_file(const struct term_table* table, const struct hashtable* dictionary, const char* path) {
+    if (!host_is_little_endian()) {
+        return INDEX_UNSUPPORTED;
+    }
+    struct index_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.format_version = INDEX_FORMAT_VERSION;
+    header.num_verses = NUM_VERSES;
+    header.terms_offset = sizeof(struct index_header);
+
+    // Gather the table's terms and sort them so that the file is deterministic and its dictionary ordered
+    struct element** sorted = (struct element**) malloc((table->num_lists ? table->num_lists : 1) * sizeof(struct element*));
+    const struct posting_list** lists = (const struct posting_list**) malloc((table->num_lists ? table->num_lists : 1) * sizeof(struct posting_list*));
+    if (sorted == NULL || lists == NULL) {
+        free(sorted);
+        free(lists);
+        return INDEX_ALLOC_ERROR;
+    }
+    size_t count = 0;
+    uint64_t num_postings = 0;
+    for (uint32_t term = 0; term < table->num_terms; term++) {
+        if (table->terms[term]) {
+            sorted[count++] = &dictionary->elements[term];
+            num_postings += table->lists[table->terms[term] - 1].length;
+        }
+    }
+    qsort(sorted, count, sizeof(struct element*), compare_elements);
+    for (size_t i = 0; i < count; i++) {
+        lists[i] = get_posting_list(table, (uint32_t) (sorted[i] - dictionary->elements));
+    }
+    header.num_terms = (uint32_t) count;
+    header.num_postings = (uint32_t) num_postings;
+    header.postings_offset = header.terms_offset + (uint32_t)(count * sizeof(struct element));
+
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        free(sorted);
+        free(lists);
+        return INDEX_IO_ERROR;
+    }
+    // The header is written again at the end, once the size of the postings is known
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    // Term dictionary, with offsets for the postings in the same order
+    struct element term;
+    uint32_t offset = 0;
+    for (size_t i = 0; ok && i < count; i++) {
+        memset(&term, 0, sizeof(term));
+        // Dictionary keys always fit, terminator included
+        memcpy(term.key, sorted[i]->key, strnlen(sorted[i]->key, KEY_SIZE - 1));
+        term.offset = offset;
+        term.length = lists[i]->length;
+        offset += (uint32_t) encoded_postings_size(get_list_postings(table, lists[i]), lists[i]->length);
+        ok = fwrite(&term, sizeof(term), 1, file) == 1;
+    }
+
+    // Postings, and the padding decoders may read into
+    for (size_t i = 0; ok && i < count; i++) {
+        const uint8_t* postings = get_list_postings(table, lists[i]);
+        size_t size = encoded_postings_size(postings, lists[i]->length);
+        ok = fwrite(postings, 1, size, file) == size;
+    }
+    static const uint8_t padding[POSTING_PADDING] = {0};
+    ok = ok && fwrite(padding, 1, POSTING_PADDING, file) == POSTING_PADDING;
+
+    header.postings_size = offset;
+    ok = ok && !fseek(file, 0, SEEK_SET) && fwrite(&header, sizeof(header), 1, file) == 1;
+
+    free(sorted);
+    free(lists);
+    if (fclose(file) || !ok) {
+        return INDEX_IO_ERROR;
+    }
+    return INDEX_OK;
+}
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef JSON_FILE_H
+#define JSON_FILE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "hashtable.h"
+#include "parse_json.h"
+#include "index_file.h"
+
+#ifdef HAVE_BZLIB
+#include <bzlib.h>
+#endif
+
+// Size of the compressed and decompressed buffers, which bounds the memory used while loading
+#define JSON_FILE_CHUNK_SIZE (64 * 1024)
+
+#ifdef HAVE_BZLIB
+// Read the next chunk of compressed input
+static inline int fill_bz_input(bz_stream* bz, char* in_buffer, FILE* file, int* at_eof) {
+    bz->next_in = in_buffer;
+    bz->avail_in = (unsigned int) fread(in_buffer, 1, JSON_FILE_CHUNK_SIZE, file);
+    if (ferror(file)) {
+        return INDEX_IO_ERROR;
+    }
+    *at_eof = bz->avail_in < JSON_FILE_CHUNK_SIZE;
+    return INDEX_OK;
+}
+#endif
+
+/*
+ * Load a bzip2-compressed JSON file of posting lists, or of positional lists if `positions` is set, into an empty
+ * table. The file is decompressed and parsed a chunk at a time, so the whole JSON string never exists in memory.
+ * This does not touch any Python objects, so it is safe to call without the GIL.
+ */
+static inline int load_json_lists(const char* path, struct hashtable* ht, int positions) {
+#ifdef HAVE_BZLIB
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return INDEX_IO_ERROR;
+    }
+    char* in_buffer = (char*) malloc(JSON_FILE_CHUNK_SIZE);
+    char* out_buffer = (char*) malloc(JSON_FILE_CHUNK_SIZE);
+    if (in_buffer == NULL || out_buffer == NULL) {
+        free(in_buffer);
+        free(out_buffer);
+        fclose(file);
+        return INDEX_ALLOC_ERROR;
+    }
+
+    struct json_stream js;
+    json_stream_init(&js);
+    js.positions = positions;
+    bz_stream bz;
+    memset(&bz, 0, sizeof(bz));
+    int error = INDEX_OK,
+        bz_status = BZ2_bzDecompressInit(&bz, 0, 0),
+        at_eof = 0;
+    if (bz_status != BZ_OK) {
+        error = INDEX_ALLOC_ERROR;
+        goto cleanup;
+    }
+
+    while (error == INDEX_OK) {
+        // Refill the input once it has all been decompressed
+        if (bz.avail_in == 0 && !at_eof) {
+            error = fill_bz_input(&bz, in_buffer, file, &at_eof);
+            if (error != INDEX_OK) {
+                break;
+            }
+        }
+
+        bz.next_out = out_buffer;
+        bz.avail_out = JSON_FILE_CHUNK_SIZE;
+        bz_status = BZ2_bzDecompress(&bz);
+        if (bz_status != BZ_OK && bz_status != BZ_STREAM_END) {
+            error = INDEX_BAD_FORMAT;
+            break;
+        }
+
+        // Parse whatever was decompressed
+        int parse_error = parse_json_chunk(&js, out_buffer, JSON_FILE_CHUNK_SIZE - bz.avail_out, ht);
+        if (parse_error) {
+            error = parse_error == JSON_ERROR_ALLOC ? INDEX_ALLOC_ERROR : INDEX_BAD_FORMAT;
+            break;
+        }
+
+        if (bz_status == BZ_STREAM_END) {
+            if (bz.avail_in == 0 && !at_eof) {
+                error = fill_bz_input(&bz, in_buffer, file, &at_eof);
+            }
+            // No more input, so we're done
+            if (error != INDEX_OK || bz.avail_in == 0) {
+                break;
+            }
+            // Like Python's bz2 module, accept several concatenated streams
+            char* next_in = bz.next_in;
+            unsigned int avail_in = bz.avail_in;
+            BZ2_bzDecompressEnd(&bz);
+            memset(&bz, 0, sizeof(bz));
+            if (BZ2_bzDecompressInit(&bz, 0, 0) != BZ_OK) {
+                error = INDEX_ALLOC_ERROR;
+                break;
+            }
+            bz.next_in = next_in;
+            bz.avail_in = avail_in;
+        }
+        // Out of input in the middle of a stream, so the file is truncated
+        else if (bz.avail_in == 0 && at_eof && bz.avail_out != 0) {
+            error = INDEX_BAD_FORMAT;
+        }
+    }
+    BZ2_bzDecompressEnd(&bz);
+
+    // Anything but a complete document is an error
+    if (error == INDEX_OK && js.state != JSON_SEEK_KEY) {
+        error = INDEX_BAD_FORMAT;
+    }
+    shrink_postings(ht);
+
+cleanup:
+    json_stream_free(&js);
+    free(in_buffer);
+    free(out_buffer);
+    fclose(file);
+    return error;
+#else
+    (void) path;
+    (void) ht;
+    (void) positions;
+    return INDEX_NO_BZIP2;
+#endif
+}
+
+// Load a bzip2-compressed JSON index (`*.json.pbz2`) into an empty table
+static inline int load_json_file(const char* path, struct hashtable* ht) {
+    return load_json_lists(path, ht, 0);
+}
+
+// Load a bzip2-compressed JSON positional index (`*.positions.json.pbz2`, see positions.h) into an empty table
+static inline int load_positions_file(const char* path, struct hashtable* ht) {
+    return load_json_lists(path, ht, 1);
+}
+
+#endif
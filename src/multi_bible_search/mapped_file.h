@@ -0,0 +1,122 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <errno.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// A read-only view of a whole file
+struct mapped_file
+{
+    const uint8_t* data;
+    size_t size;
+};
+
+#ifdef _WIN32
+// Set errno from the last Windows error, so that failures are reported the same way on every platform
+static inline int map_file_error(void) {
+    DWORD error = GetLastError();
+    if (error == ERROR_FILE_NOT_FOUND || error == ERROR_PATH_NOT_FOUND) {
+        errno = ENOENT;
+    }
+    else if (error == ERROR_ACCESS_DENIED || error == ERROR_SHARING_VIOLATION) {
+        errno = EACCES;
+    }
+    else {
+        errno = EIO;
+    }
+    return -1;
+}
+#endif
+
+// Map the file at `path` read-only. Returns 0 on success, -1 on failure with errno set
+static inline int map_file(const char* path, struct mapped_file* mf) {
+    mf->data = NULL;
+    mf->size = 0;
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return map_file_error();
+    }
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size)) {
+        CloseHandle(file);
+        return map_file_error();
+    }
+    // An empty file can't be mapped, and can't be a valid index either
+    if (file_size.QuadPart == 0) {
+        CloseHandle(file);
+        errno = EINVAL;
+        return -1;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL) {
+        map_file_error();
+        CloseHandle(file);
+        return -1;
+    }
+    // The view keeps the mapping alive, so neither handle is needed after this
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == NULL) {
+        map_file_error();
+    }
+    CloseHandle(mapping);
+    CloseHandle(file);
+    if (view == NULL) {
+        return -1;
+    }
+    mf->data = (const uint8_t*) view;
+    mf->size = (size_t) file_size.QuadPart;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st)) {
+        close(fd);
+        return -1;
+    }
+    // An empty file can't be mapped, and can't be a valid index either
+    if (st.st_size == 0) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    void* view = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping holds its own reference to the file
+    close(fd);
+    if (view == MAP_FAILED) {
+        return -1;
+    }
+    mf->data = (const uint8_t*) view;
+    mf->size = (size_t) st.st_size;
+#endif
+    return 0;
+}
+
+// Release a mapping made by `map_file`
+static inline void unmap_file(struct mapped_file* mf) {
+    if (mf->data == NULL) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile((LPCVOID) mf->data);
+#else
+    munmap((void*) mf->data, mf->size);
+#endif
+    mf->data = NULL;
+    mf->size = 0;
+}
+
+#endif
@@ -0,0 +1,218 @@
+#ifndef MERGE_H
+#define MERGE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdint.h>
+#include "cpu_features.h"
+#include "postings.h"
+#include "arena.h"
+
+typedef struct result_pair {
+    uint32_t element;
+    uint_fast16_t count;
+} result_pair;
+
+// An encoded posting list to merge, and what each of its references adds to that reference's count
+struct merge_source
+{
+    const uint8_t* postings;
+    uint32_t length;
+    int weight;
+    // Index of the query token it's a list of. The lists of a token (one per table) never have a verse in common
+    int token;
+};
+
+/*
+ * Lists are decoded before they're merged, each followed by MERGE_PADDING copies of MERGE_DONE, which is larger than
+ * any reference, so that scanning one stops at its end without checking.
+ */
+#define MERGE_DONE UINT32_MAX
+#define MERGE_PADDING 8
+// Runs of the winning list up to this long are scanned inline, and only longer ones by `merge_run`
+#define MERGE_SHORT_RUN 8
+
+/*
+ * Kernels finding the end of a run: the first value of a padded list, from `values` on, that's past `bound`, which is
+ * less than MERGE_DONE.
+ */
+typedef const uint32_t* (*run_kernel)(const uint32_t* values, uint32_t bound);
+
+static const uint32_t* merge_run_scalar(const uint32_t* values, uint32_t bound) {
+    while (*values <= bound) {
+        values++;
+    }
+    return values;
+}
+
+#ifdef CPU_X86_SIMD
+/*
+ * The SIMD kernels compare a vector at a time: a value is within the bound if the unsigned max of the two is the
+ * bound. As the values are sorted, the first one past it is the lowest lane that isn't. Vectors never read past the
+ * padding.
+ */
+TARGET_SSE42 static const uint32_t* merge_run_sse42(const uint32_t* values, uint32_t bound) {
+    const __m128i limit = _mm_set1_epi32((int) bound);
+    for (;; values += 4) {
+        __m128i within = _mm_cmpeq_epi32(_mm_max_epu32(_mm_loadu_si128((const __m128i*) values), limit), limit);
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(within));
+        if (mask != 0xF) {
+            return values + lowest_bit((uint64_t) (~mask & 0xF));
+        }
+    }
+}
+
+TARGET_AVX2 static const uint32_t* merge_run_avx2(const uint32_t* values, uint32_t bound) {
+    const __m256i limit = _mm256_set1_epi32((int) bound);
+    for (;; values += 8) {
+        __m256i within = _mm256_cmpeq_epi32(_mm256_max_epu32(_mm256_loadu_si256((const __m256i*) values), limit), limit);
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(within));
+        if (mask != 0xFF) {
+            return values + lowest_bit((uint64_t) (~mask & 0xFF));
+        }
+    }
+}
+#endif
+
+// Run kernel for this CPU, picked by `init_merge_kernels`
+static run_kernel merge_run = merge_run_scalar;
+
+// Pick the run kernel. Call once before merging anything
+static inline void init_merge_kernels(void) {
+    merge_run = merge_run_scalar;
+#ifdef CPU_X86_SIMD
+    int features = cpu_features();
+    if (features & CPU_AVX2) {
+        merge_run = merge_run_avx2;
+    }
+    else if (features & CPU_SSE42) {
+        merge_run = merge_run_sse42;
+    }
+#endif
+}
+
+/*
+ * Loser tree entries pack a list's current reference above the list's index,
+ * so that a match is a single integer comparison the compiler can do without branching.
+ */
+static inline uint64_t merge_entry(uint32_t value, int i) {
+    return ((uint64_t) value << 32) | (uint32_t) i;
+}
+
+/*
+ * Merge the posting lists of every source into `dest` in one pass, with a loser tree over the decoded lists.
+ * Each distinct reference appears once in `dest`, in ascending order, with the total weight of the sources it's in.
+ * Assumes that the size of `dest` is the total length of the sources. Returns the number of results, its scratch
+ * memory coming from the arena, or -1 if that runs out.
+ *
+ * The winning list stays ahead up to the runner-up, the best of the entries it beat on its way to the root, so all of
+ * its references up to there go out in one run (see `merge_run`) before its matches are replayed.
+ */
+static inline ptrdiff_t merge_postings(const struct merge_source* sources, int num_sources, result_pair * restrict dest,
+                                      struct arena* arena) {
+    if (num_sources == 0) {
+        return 0;
+    }
+    int k = num_sources;
+    size_t total = 0;
+    for (int i = 0; i < k; i++) {
+        total += sources[i].length;
+    }
+    // Every list, padded, back to back, and where each one is up to
+    uint32_t* lists = (uint32_t*) arena_alloc(arena, (total + (size_t) k * MERGE_PADDING) * sizeof(uint32_t));
+    const uint32_t** next = (const uint32_t**) arena_alloc(arena, k * sizeof(uint32_t*));
+    /*
+     * Leaf i is node k + i, and the children of internal node t are 2t and 2t + 1.
+     * Internal nodes 1 to k - 1 keep the loser of their match, and node 0 is unused, as the winner is kept aside.
+     */
+    uint64_t* tree = (uint64_t*) arena_alloc(arena, 2 * k * sizeof(uint64_t));
+    // Winner of each internal node's match, only while building
+    uint64_t* winners = (uint64_t*) arena_alloc(arena, k * sizeof(uint64_t));
+    if (lists == NULL || next == NULL || tree == NULL || winners == NULL) {
+        printf("Memory allocation failure in merge_postings\n");
+        return -1;
+    }
+
+    // Build the tree bottom up
+    uint32_t* list = lists;
+    for (int i = 0; i < k; i++) {
+        decode_postings(sources[i].postings, sources[i].length, list);
+        for (int j = 0; j < MERGE_PADDING; j++) {
+            list[sources[i].length + j] = MERGE_DONE;
+        }
+        next[i] = list;
+        tree[k + i] = merge_entry(list[0], i);
+        list += sources[i].length + MERGE_PADDING;
+    }
+    for (int t = k - 1; t >= 1; t--) {
+        uint64_t left = 2 * t >= k ? tree[2 * t] : winners[2 * t],
+                 right = 2 * t + 1 >= k ? tree[2 * t + 1] : winners[2 * t + 1];
+        winners[t] = left < right ? left : right;
+        tree[t] = left < right ? right : left;
+    }
+    uint64_t winner = k > 1 ? winners[1] : tree[k];
+
+    size_t n = 0;
+    uint32_t last = MERGE_DONE;
+    uint_fast16_t count = 0;
+    for (;;) {
+        uint32_t value = (uint32_t) (winner >> 32);
+        int w = (int) (uint32_t) winner;
+        if (value == MERGE_DONE) {
+            break;
+        }
+        uint_fast16_t weight = (uint_fast16_t) sources[w].weight;
+        // Sources are sorted, so a repeat can only be of the last result. The result is written either way, without
+        // branching on which it is
+        int repeat = value == last;
+        n += !repeat;
+        count = repeat ? count + weight : weight;
+        dest[n - 1].element = value;
+        dest[n - 1].count = count;
+        last = value;
+        const uint32_t* values = ++next[w];
+
+        // Lists that take turns mostly don't have a run, which the entry the winner beat last already shows
+        int parent = (k + w) / 2;
+        if (parent == 0 || *values <= (uint32_t) (tree[parent] >> 32)) {
+            // A list on its own runs up to its padding
+            uint32_t bound = MERGE_DONE - 1;
+            for (int t = parent; t > 0; t /= 2) {
+                uint32_t key = (uint32_t) (tree[t] >> 32);
+                bound = key < bound ? key : bound;
+            }
+            const uint32_t* end = values;
+            while (end < values + MERGE_SHORT_RUN && *end <= bound) {
+                end++;
+            }
+            if (end == values + MERGE_SHORT_RUN) {
+                end = merge_run(end, bound);
+            }
+            // Each of these is new, and the last of them is the one a repeat would be of
+            for (; values < end; values++) {
+                dest[n].element = *values;
+                dest[n++].count = weight;
+            }
+            if (values != next[w]) {
+                last = values[-1];
+                count = weight;
+                next[w] = values;
+            }
+        }
+
+        // Replay its matches up to the root
+        uint64_t entry = merge_entry(*values, w);
+        for (int t = (k + w) / 2; t > 0; t /= 2) {
+            uint64_t other = tree[t];
+            tree[t] = entry < other ? other : entry;
+            entry = entry < other ? entry : other;
+        }
+        winner = entry;
+    }
+
+    return (ptrdiff_t) n;
+}
+
+#endif
@@ -5,6 +5,18 @@
 #include "hashtable.h"
 #include "rank.h"
 #include "parse_json.h"
+#include "dictionary.h"
+#include "index_file.h"
+#include "json_file.h"
+#include "accumulate.h"
+#include "topk.h"
+#include "rwlock.h"
+#include "cache.h"
+#include "tokenize.h"
+#include "plan.h"
+#include "positions.h"
+#include "boolean.h"
+#include "prefix.h"
 
 // Tell MSVC it's fine
 #pragma warning(disable : 4996)
@@ -26,342 +38,62 @@
 // This should be the same as the highest combined index's index
 #define COMBINED_INDEX_OFFSET 9
 
-// This is an ever so slight, single use optimization over itoa
-static inline void ref_to_str(uint_fast16_t num, char* str) {
-    // This covers the range of possible chapter and verse values of a reference. 
-    static const char* numbers[] = { "\0", // NULL sentinel
-        "1", "2", "3", "4", "5", "6", "7", "8", "9", "10",
-        "11", "12", "13", "14", "15", "16", "17", "18", "19", "20",
-        "21", "22", "23", "24", "25", "26", "27", "28", "29", "30",
-        "31", "32", "33", "34", "35", "36", "37", "38", "39", "40",
-        "41", "42", "43", "44", "45", "46", "47", "48", "49", "50",
-        "51", "52", "53", "54", "55", "56", "57", "58", "59", "60",
-        "61", "62", "63", "64", "65", "66", "67", "68", "69", "70",
-        "71", "72", "73", "74", "75", "76", "77", "78", "79", "80",
-        "81", "82", "83", "84", "85", "86", "87", "88", "89", "90",
-        "91", "92", "93", "94", "95", "96", "97", "98", "99", "100",
-        "101", "102", "103", "104", "105", "106", "107", "108", "109", "110",
-        "111", "112", "113", "114", "115", "116", "117", "118", "119", "120",
-        "121", "122", "123", "124", "125", "126", "127", "128", "129", "130",
-        "131", "132", "133", "134", "135", "136", "137", "138", "139", "140",
-        "141", "142", "143", "144", "145", "146", "147", "148", "149", "150",
-        "151", "152", "153", "154", "155", "156", "157", "158", "159", "160",
-        "161", "162", "163", "164", "165", "166", "167", "168", "169", "170",
-        "171", "172", "173", "174", "175", "176", "\0" // NULL sentinel
-    };
-    
-    strcat(str, numbers[num]);
-}
-static inline void ref_to_str_colon(uint_fast16_t num, char* str) {
-    // This covers the range of possible chapter and verse values of a reference. 
-    static const char* numbers[] = { "\0", // NULL sentinel
-        "1:", "2:", "3:", "4:", "5:", "6:", "7:", "8:", "9:", "10:", 
-        "11:", "12:", "13:", "14:", "15:", "16:", "17:", "18:", "19:", 
-        "20:", "21:", "22:", "23:", "24:", "25:", "26:", "27:", "28:", 
-        "29:", "30:", "31:", "32:", "33:", "34:", "35:", "36:", "37:", 
-        "38:", "39:", "40:", "41:", "42:", "43:", "44:", "45:", "46:", 
-        "47:", "48:", "49:", "50:", "51:", "52:", "53:", "54:", "55:", 
-        "56:", "57:", "58:", "59:", "60:", "61:", "62:", "63:", "64:", 
-        "65:", "66:", "67:", "68:", "69:", "70:", "71:", "72:", "73:", 
-        "74:", "75:", "76:", "77:", "78:", "79:", "80:", "81:", "82:", 
-        "83:", "84:", "85:", "86:", "87:", "88:", "89:", "90:", "91:", 
-        "92:", "93:", "94:", "95:", "96:", "97:", "98:", "99:", "100:", 
-        "101:", "102:", "103:", "104:", "105:", "106:", "107:", "108:", 
-        "109:", "110:", "111:", "112:", "113:", "114:", "115:", "116:", 
-        "117:", "118:", "119:", "120:", "121:", "122:", "123:", "124:", 
-        "125:", "126:", "127:", "128:", "129:", "130:", "131:", "132:", 
-        "133:", "134:", "135:", "136:", "137:", "138:", "139:", "140:", 
-        "141:", "142:", "143:", "144:", "145:", "146:", "147:", "148:", 
-        "149:", "150:", "151:", "152:", "153:", "154:", "155:", "156:", 
-        "157:", "158:", "159:", "160:", "161:", "162:", "163:", "164:", 
-        "165:", "166:", "167:", "168:", "169:", "170:", "171:", "172:", 
-        "173:", "174:", "175:", "176:", "\0" // NULL sentinel
-    };
-    
-    strcat(str, numbers[num]);
-}
+// The interned Python string of each verse ID, made the first time it's a result and kept for good
+static PyObject *verse_strings[NUM_VERSES];
 
-// Translate numeric references to Python strings
-static inline PyObject* rtranslate(uint32_t reference) {
-    // Buffer for up to the longest reference would be 20,
-    // but it is bumped up to 24 for the longest invalid reference
-    char reference_buffer[24];
-    uint_fast8_t book = reference / 1000000;        // Extract the part of the number that represents the book
-    uint_fast16_t remainder = reference % 1000000;  // Extract the remaining part after removing the book
-    uint_fast16_t chapter = remainder / 1000;       // Extract the chapter reference
-    uint_fast16_t verse = remainder % 1000;         // Extract the verse reference
-
-    // Add to the reference buffer based on the book number
-    switch(book) {
-        case 1:
-            strcpy(reference_buffer, "Genesis ");
-            break;
-        case 2:
-            strcpy(reference_buffer, "Exodus ");
-            break;
-        case 3:
-            strcpy(reference_buffer, "Leviticus ");
-            break;
-        case 4:
-            strcpy(reference_buffer, "Numbers ");
-            break;
-        case 5:
-            strcpy(reference_buffer, "Deuteronomy ");
-            break;
-        case 6:
-            strcpy(reference_buffer, "Joshua ");
-            break;
-        case 7:
-            strcpy(reference_buffer, "Judges ");
-            break;
-        case 8:
-            strcpy(reference_buffer, "Ruth ");
-            break;
-        case 9:
-            strcpy(reference_buffer, "1 Samuel ");
-            break;
-        case 10:
-            strcpy(reference_buffer, "2 Samuel ");
-            break;
-        case 11:
-            strcpy(reference_buffer, "1 Kings ");
-            break;
-        case 12:
-            strcpy(reference_buffer, "2 Kings ");
-            break;
-        case 13:
-            strcpy(reference_buffer, "1 Chronicles ");
-            break;
-        case 14:
-            strcpy(reference_buffer, "2 Chronicles ");
-            break;
-        case 15:
-            strcpy(reference_buffer, "Ezra ");
-            break;
-        case 16:
-            strcpy(reference_buffer, "Nehemiah ");
-            break;
-        case 17:
-            strcpy(reference_buffer, "Esther ");
-            break;
-        case 18:
-            strcpy(reference_buffer, "Job ");
-            break;
-        case 19:
-            strcpy(reference_buffer, "Psalms ");
-            break;
-        case 20:
-            strcpy(reference_buffer, "Proverbs ");
-            break;
-        case 21:
-            strcpy(reference_buffer, "Ecclesiastes ");
-            break;
-        case 22:
-            strcpy(reference_buffer, "Song of Solomon ");
-            break;
-        case 23:
-            strcpy(reference_buffer, "Isaiah ");
-            break;
-        case 24:
-            strcpy(reference_buffer, "Jeremiah ");
-            break;
-        case 25:
-            strcpy(reference_buffer, "Lamentations ");
-            break;
-        case 26:
-            strcpy(reference_buffer, "Ezekiel ");
-            break;
-        case 27:
-            strcpy(reference_buffer, "Daniel ");
-            break;
-        case 28:
-            strcpy(reference_buffer, "Hosea ");
-            break;
-        case 29:
-            strcpy(reference_buffer, "Joel ");
-            break;
-        case 30:
-            strcpy(reference_buffer, "Amos ");
-            break;
-        case 31:
-            strcpy(reference_buffer, "Obadiah ");
-            break;
-        case 32:
-            strcpy(reference_buffer, "Jonah ");
-            break;
-        case 33:
-            strcpy(reference_buffer, "Micah ");
-            break;
-        case 34:
-            strcpy(reference_buffer, "Nahum ");
-            break;
-        case 35:
-            strcpy(reference_buffer, "Habakkuk ");
-            break;
-        case 36:
-            strcpy(reference_buffer, "Zephaniah ");
-            break;
-        case 37:
-            strcpy(reference_buffer, "Haggai ");
-            break;
-        case 38:
-            strcpy(reference_buffer, "Zechariah ");
-            break;
-        case 39:
-            strcpy(reference_buffer, "Malachi ");
-            break;
-        case 40:
-            strcpy(reference_buffer, "Matthew ");
-            break;
-        case 41:
-            strcpy(reference_buffer, "Mark ");
-            break;
-        case 42:
-            strcpy(reference_buffer, "Luke ");
-            break;
-        case 43:
-            strcpy(reference_buffer, "John ");
-            break;
-        case 44:
-            strcpy(reference_buffer, "Acts ");
-            break;
-        case 45:
-            strcpy(reference_buffer, "Romans ");
-            break;
-        case 46:
-            strcpy(reference_buffer, "1 Corinthians ");
-            break;
-        case 47:
-            strcpy(reference_buffer, "2 Corinthians ");
-            break;
-        case 48:
-            strcpy(reference_buffer, "Galatians ");
-            break;
-        case 49:
-            strcpy(reference_buffer, "Ephesians ");
-            break;
-        case 50:
-            strcpy(reference_buffer, "Philippians ");
-            break;
-        case 51:
-            strcpy(reference_buffer, "Colossians ");
-            break;
-        case 52:
-            strcpy(reference_buffer, "1 Thessalonians ");
-            break;
-        case 53:
-            strcpy(reference_buffer, "2 Thessalonians ");
-            break;
-        case 54:
-            strcpy(reference_buffer, "1 Timothy ");
-            break;
-        case 55:
-            strcpy(reference_buffer, "2 Timothy ");
-            break;
-        case 56:
-            strcpy(reference_buffer, "Titus ");
-            break;
-        case 57:
-            strcpy(reference_buffer, "Philemon ");
-            break;
-        case 58:
-            strcpy(reference_buffer, "Hebrews ");
-            break;
-        case 59:
-            strcpy(reference_buffer, "James ");
-            break;
-        case 60:
-            strcpy(reference_buffer, "1 Peter ");
-            break;
-        case 61:
-            strcpy(reference_buffer, "2 Peter ");
-            break;
-        case 62:
-            strcpy(reference_buffer, "1 John ");
-            break;
-        case 63:
-            strcpy(reference_buffer, "2 John ");
-            break;
-        case 64:
-            strcpy(reference_buffer, "3 John ");
-            break;
-        case 65:
-            strcpy(reference_buffer, "Jude ");
-            break;
-        case 66:
-            strcpy(reference_buffer, "Revelation ");
-            break;
-        default:
+// Translate a verse ID to its Python string, returning a new reference. Call with the GIL
+static inline PyObject* rtranslate(uint32_t verse) {
+    // Quick bounds check
+    if (verse >= NUM_VERSES) { return NULL; }
+    PyObject *name = verse_strings[verse];
+    if (name == NULL) {
+        name = PyUnicode_FromStringAndSize(&verse_names[verse_name_offsets[verse]],
+                                           verse_name_offsets[verse + 1] - verse_name_offsets[verse]);
+        if (name == NULL) {
             return NULL;
+        }
+        PyUnicode_InternInPlace(&name);
+        verse_strings[verse] = name;
     }
-
-    // Quick bounds check
-    if (verse > 176 || chapter > 176) { return NULL; }
-
-    // Add the chapter number and colon
-    ref_to_str_colon(chapter, reference_buffer);
-
-    // Add the verse number
-    ref_to_str(verse, reference_buffer);
-
-    return PyUnicode_FromString(reference_buffer);
+    Py_INCREF(name);
+    return name;
 }
 
-// Tokenizes a given string based on spaces
-static inline char **tokenize(const char * input_string, int *num_tokens, int *len_tokens) {
-    // Allocate memory for token array
-    *len_tokens = strlen(input_string) + 1;
-    char **tokens = calloc(*len_tokens, sizeof(char *));
-    if (tokens == NULL) {
-        // Handle memory allocation failure
-        return NULL;
-    }
-
-    const char *ptr = input_string;
-    const char *start;
-    uint64_t count = 0, token_len;
-
-    // Tokenize the string based on spaces
-    while (*ptr != '\0') {
-        // Skip leading non-alphabetic characters
-        while (*ptr != '\0' && !isalpha(*ptr)) {
-            ptr++;
-        }
-
-        // Find the start of the token
-        start = ptr;
+// Most searches' scratch kept by an object for the next ones, about as many as run at once
+#define SCRATCH_POOL_SIZE 8
 
-        // Find the end of the token
-        while (*ptr != '\0' && isalpha(*ptr)) {
-            ptr++;
-        }
+// What a search works in, kept for the next one: counters for queries too broad to merge, and its memory
+struct search_scratch
+{
+    struct verse_accumulator accumulator;
+    struct arena arena;
+    struct search_scratch *next;
+};
 
-        // Extract the token
-        if ((token_len = ptr - start)) {
-            //token_len = ptr - start;
-            tokens[count] = malloc(token_len + 1);
-            if (tokens[count] == NULL) {
-                // Handle memory allocation failure
-                for (int i = 0; i < count; i++) {
-                    free(tokens[i]);
-                }
-                free(tokens);
-                return NULL;
-            } 
-            strncpy(tokens[count], start, token_len);
-            tokens[count][token_len] = '\0';
-            count++;
-        }
-    }
-    *num_tokens = count;
-    return tokens;
+static inline void delete_scratch(struct search_scratch *scratch) {
+    delete_accumulator(&scratch->accumulator);
+    delete_arena(&scratch->arena);
+    free(scratch);
 }
 
 // Structure to hold data for the module
 typedef struct {
     PyObject_HEAD
     PyObject *versions;
-    struct hashtable **ht;
+    // Shared by every table, mapping keys to term IDs
+    struct hashtable dictionary;
+    struct term_table **tables;
+    // Positional index of each version's table, for phrase searches, loaded separately
+    struct term_table positions[NUM_TABLES];
+    // Held to read the tables and dictionary (searches, without the GIL) or change them (loading and unloading)
+    struct rwlock lock;
+    // Scratch of past searches, free for the next ones, and the lock for taking them
+    struct search_scratch *scratch_pool;
+    int pooled_scratch;
+    PyThread_type_lock scratch_lock;
+    // Ranked results of recent queries, and the lock for using it
+    struct result_cache cache;
+    PyThread_type_lock cache_lock;
 } SearchObject;
 
 // triple of associated references
@@ -377,20 +109,25 @@ typedef struct triple{
 
 // Allocates empty tables
 void allocate_tables(SearchObject *self) {
-    self->ht = calloc(NUM_TABLES, sizeof(struct hashtable));
-    if (self->ht == NULL) {
+    reset_table(&self->dictionary);
+    self->scratch_pool = NULL;
+    self->pooled_scratch = 0;
+    reset_cache(&self->cache);
+    self->tables = calloc(NUM_TABLES, sizeof(struct term_table*));
+    if (self->tables == NULL) {
         printf("Error allocating internal tables\n");
         return;
     }
     for (int i = 0; i < NUM_TABLES; i++) {
-        self->ht[i] = (struct hashtable*) malloc(sizeof(struct hashtable));
-        if (self->ht[i] == NULL) {
+        self->tables[i] = (struct term_table*) malloc(sizeof(struct term_table));
+        if (self->tables[i] == NULL) {
             printf("Error allocating internal table\n");
             return;
         }
-        self->ht[i]->elements = NULL;
-        self->ht[i]->size = 0;
-        self->ht[i]->num_elements = 0;
+        reset_term_table(self->tables[i]);
+    }
+    for (int i = 0; i < NUM_TABLES; i++) {
+        reset_term_table(&self->positions[i]);
     }
 }
 
@@ -549,6 +286,7 @@ triple get_table_index(const char* version) {
             indices.a = 0;
             break;
         }
+        break;
 
     // MSG
     case 'M':
@@ -676,22 +414,181 @@ triple get_table_index(const char* version) {
     return indices;
 }
 
+// Associates a version or combined index name with the table it is loaded into. Returns -1 for invalid names
+short get_load_index(const char* version) {
+    // Check if the version is a combined index
+    if (!strcmp(version, "AllEng")) {
+        return ENGLISH_ALL;
+    }
+    else if (!strcmp(version, "AllEs")) {
+        return SPANISH_ALL;
+    }
+    else if (!strcmp(version, "KJV-like")) {
+        return KJV_LIKE;
+    }
+    else if (!strcmp(version, "NIV")) {
+        return NIV;
+    }
+    else if (!strcmp(version, "Literal")) {
+        return LITERAL;
+    }
+    else if (!strcmp(version, "Literal2")) {
+        return LITERAL2;
+    }
+    else if (!strcmp(version, "Literal3")) {
+        return LITERAL3;
+    }
+    else if (!strcmp(version, "Dynamic")) {
+        return DYNAMIC;
+    }
+    else if (!strcmp(version, "EsRV")) {
+        return ES_RV;
+    }
+    else if (!strcmp(version, "ExtraEng")) {
+        return EXTRA_ENG;
+    }
+    // If not, use `get_table_index` to find the right one for this version
+    short table_index = get_table_index(version).a;
+    return table_index ? table_index : -1;
+}
+
+// Raise an exception for an invalid version, returning NULL for the caller to pass along
+static PyObject *set_invalid_version(const char *version) {
+    PyErr_Format(PyExc_RuntimeError, "Invalid version: %.80s", version);
+    return NULL;
+}
+
+// Raise an exception for a failed index file load/save, returning NULL for the caller to pass along
+static PyObject *set_index_error(int error, const char *path) {
+    if (error == INDEX_IO_ERROR) {
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
+    }
+    PyErr_Format(PyExc_RuntimeError, "%s: %s", index_error_string(error), path);
+    return NULL;
+}
+
+// Drop the cached results of every version searching a table that changed, under the write lock
+static void invalidate_cached_table(SearchObject *self, short table_index) {
+    PyThread_acquire_lock(self->cache_lock, WAIT_LOCK);
+    cache_invalidate_table(&self->cache, (uint8_t) table_index);
+    PyThread_release_lock(self->cache_lock);
+}
+
+/*
+ * Install a freshly loaded table as the given table, unless another thread got there first.
+ * Either way, `table` is used up.
+ */
+static PyObject *install_loaded_table(SearchObject *self, short table_index, struct hashtable *table) {
+    int error = 0;
+    // Searches hold the read lock without the GIL, so wait for them without it too
+    Py_BEGIN_ALLOW_THREADS
+    rwlock_write(&self->lock);
+    Py_END_ALLOW_THREADS
+    if (term_table_loaded(self->tables[table_index])) {
+        delete_table(table);
+    }
+    else if (install_table(&self->dictionary, table, self->tables[table_index])) {
+        delete_table(table);
+        error = 1;
+    }
+    else {
+        invalidate_cached_table(self, table_index);
+    }
+    rwlock_write_unlock(&self->lock);
+    if (error) {
+        return PyErr_NoMemory();
+    }
+    Py_RETURN_NONE;
+}
+
 // Function to initialize the SearchObject
 static int SearchObject_init(SearchObject *self, PyObject *args) {
+    if (self->scratch_lock == NULL) {
+        if (rwlock_init(&self->lock)) {
+            PyErr_SetString(PyExc_RuntimeError, "Error allocating the table lock");
+            return -1;
+        }
+        self->scratch_lock = PyThread_allocate_lock();
+        self->cache_lock = PyThread_allocate_lock();
+        if (self->scratch_lock == NULL || self->cache_lock == NULL) {
+            if (self->scratch_lock != NULL) {
+                PyThread_free_lock(self->scratch_lock);
+                self->scratch_lock = NULL;
+            }
+            if (self->cache_lock != NULL) {
+                PyThread_free_lock(self->cache_lock);
+                self->cache_lock = NULL;
+            }
+            rwlock_destroy(&self->lock);
+            PyErr_NoMemory();
+            return -1;
+        }
+    }
     allocate_tables(self);
     return 0;
 }
 
 // Free the object's dynamically allocated memory
 static void SearchObject_destructor(SearchObject* self) {
-    if (self->ht != NULL) {
+    if (self->tables != NULL) {
         for (int i = 0; i < NUM_TABLES; i++) {
-            if (self->ht[i] != NULL) {
-                delete_table(self->ht[i]);
-                free(self->ht[i]);
+            if (self->tables[i] != NULL) {
+                delete_term_table(self->tables[i]);
+                free(self->tables[i]);
             }
         }
-        free(self->ht);
+        free(self->tables);
+    }
+    for (int i = 0; i < NUM_TABLES; i++) {
+        delete_term_table(&self->positions[i]);
+    }
+    delete_table(&self->dictionary);
+    while (self->scratch_pool != NULL) {
+        struct search_scratch *next = self->scratch_pool->next;
+        delete_scratch(self->scratch_pool);
+        self->scratch_pool = next;
+    }
+    delete_cache(&self->cache);
+    // The locks are made together
+    if (self->scratch_lock != NULL) {
+        PyThread_free_lock(self->scratch_lock);
+        PyThread_free_lock(self->cache_lock);
+        rwlock_destroy(&self->lock);
+    }
+}
+
+// Take scratch for a search from the pool, or make more if it's empty. Returns NULL if memory runs out
+static struct search_scratch *acquire_scratch(SearchObject *self) {
+    PyThread_acquire_lock(self->scratch_lock, WAIT_LOCK);
+    struct search_scratch *scratch = self->scratch_pool;
+    if (scratch != NULL) {
+        self->scratch_pool = scratch->next;
+        self->pooled_scratch--;
+    }
+    PyThread_release_lock(self->scratch_lock);
+    if (scratch == NULL) {
+        scratch = (struct search_scratch *) malloc(sizeof(struct search_scratch));
+        if (scratch != NULL) {
+            reset_accumulator(&scratch->accumulator);
+            reset_arena_fields(&scratch->arena);
+        }
+    }
+    return scratch;
+}
+
+// Let go of everything a search allocated, and give its scratch back to the pool unless it's full
+static void release_scratch(SearchObject *self, struct search_scratch *scratch) {
+    arena_reset(&scratch->arena);
+    PyThread_acquire_lock(self->scratch_lock, WAIT_LOCK);
+    if (self->pooled_scratch < SCRATCH_POOL_SIZE) {
+        scratch->next = self->scratch_pool;
+        self->scratch_pool = scratch;
+        self->pooled_scratch++;
+        scratch = NULL;
+    }
+    PyThread_release_lock(self->scratch_lock);
+    if (scratch != NULL) {
+        delete_scratch(scratch);
     }
 }
 
@@ -701,38 +598,192 @@ static PyObject *SearchObject_versions(SearchObject *self, void *closure) {
     return self->versions;
 }
 
-// Method to perform a search
-PyObject *SearchObject_search(SearchObject *self, PyObject *args) {
-    if (!self->ht) {
-        return PyList_New(0);
+/*
+ * A tokenized query, looked up in the dictionary: the term ID of each distinct token that any table has and how many
+ * times it's counted, its prefix tokens, and what a verse with every token of the query counts to.
+ * Nothing in it depends on the version, so it's shared by every version a query is searched in.
+ */
+struct search_query
+{
+    uint32_t *terms;
+    int *token_counts;
+    int num_tokens;
+    // Prefix tokens (`bless*`), which are expanded in each table searched, and how many times each is counted
+    struct query_token *prefixes;
+    int *prefix_counts;
+    int num_prefixes;
+    int target;
+    // Its tokens sorted and joined by spaces, what it's cached under along with the version (NULL if memory ran out)
+    char *key;
+    size_t key_length;
+};
+
+static int compare_tokens(const void *a, const void *b) {
+    const struct query_token *x = (const struct query_token *) a,
+                             *y = (const struct query_token *) b;
+    int order = strcmp(x->text, y->text);
+    return order ? order : x->prefix - y->prefix;
+}
+
+// Sort a copy of the tokens and join them, into `*key` in the arena. Returns 0 on success, or -1 if memory runs out
+static int make_query_key(const struct query_token *tokens, int num_tokens, char **key, size_t *key_length,
+                          struct arena *arena) {
+    struct query_token *sorted = (struct query_token *) arena_alloc(arena, num_tokens * sizeof(struct query_token));
+    if (sorted == NULL) {
+        return -1;
     }
-    char *query1,     // The query string
-         *version,    // The version to query
-         **tokens;    // The tokenized form of the query
-    // Maximum number of results to return to Python
-    Py_ssize_t max_results = PY_SSIZE_T_MAX;
+    size_t length = 0;
+    for (int i = 0; i < num_tokens; i++) {
+        sorted[i] = tokens[i];
+        length += tokens[i].length + 1 + tokens[i].prefix;
+    }
+    qsort(sorted, num_tokens, sizeof(struct query_token), compare_tokens);
+    *key = (char *) arena_alloc(arena, length);
+    if (*key == NULL) {
+        return -1;
+    }
+    char *out = *key;
+    for (int i = 0; i < num_tokens; i++) {
+        memcpy(out, sorted[i].text, sorted[i].length);
+        out += sorted[i].length;
+        if (sorted[i].prefix) {
+            *out++ = '*';
+        }
+        *out++ = ' ';
+    }
+    *key_length = length;
+    return 0;
+}
 
-    if (!PyArg_ParseTuple(args, "ss|n", &query1, &version, &max_results)) {
-        PyObject *exception_type = PyExc_RuntimeError;
-        PyObject *exception_value = PyUnicode_FromString("Bad search arguments!\n");
-        PyObject *exception_traceback = NULL;
-        PyErr_SetObject(exception_type, exception_value);
+/*
+ * Tokenize a query and look up its tokens, under the read lock, the query living in the arena.
+ * Returns 0 on success, or -1 if the query couldn't be tokenized or memory (from the arena) runs out.
+ */
+static int prepare_query(SearchObject *self, const char *query_string, struct search_query *query,
+                         struct arena *arena) {
+    struct query_token *tokens;     // The tokenized form of the query
+    int num_tokens = 0;             // Number of tokens in the query
+
+    query->terms = NULL;
+    query->token_counts = NULL;
+    query->num_tokens = 0;
+    query->prefixes = NULL;
+    query->prefix_counts = NULL;
+    query->num_prefixes = 0;
+    query->target = 0;
+    query->key = NULL;
+    query->key_length = 0;
 
-        // Return None just in case
-        Py_RETURN_NONE;
+    // Tokenize the query
+    tokens = tokenize_query(query_string, strlen(query_string), &num_tokens, arena);
+    if (tokens == NULL) {
+        printf("Failed to tokenize query\n");
+        return -1;
     }
-    make_lower(query1);
-    // Hash table indicies to get from
-    triple table_index = get_table_index(version);
 
-    // Temporary pointer to the Python string of the reference
-    PyObject* str_ref;
+    // How many times each token is counted
+    int *token_counts = (int *)arena_alloc(arena, num_tokens * sizeof(int));
+    uint32_t *terms = (uint32_t *)arena_alloc(arena, num_tokens * sizeof(uint32_t));
+    struct query_token *prefixes = (struct query_token *)arena_alloc(arena, num_tokens * sizeof(struct query_token));
+    int *prefix_counts = (int *)arena_alloc(arena, num_tokens * sizeof(int));
+    if (token_counts == NULL || terms == NULL || prefixes == NULL || prefix_counts == NULL) {
+        printf("Internal allocation error\n");
+        return -1;
+    }
 
-    int num_tokens = 0,     // Number of tokens in the query
-        len_tokens = 0;     // Allocated length of the token list
+    // Every token counts to the ranking, but not their order
+    if (make_query_key(tokens, num_tokens, &query->key, &query->key_length, arena)) {
+        query->key = NULL;
+    }
 
-    // Tokenize the query
-    tokens = tokenize(query1, &num_tokens, &len_tokens);
+    // Repeated tokens are counted once with their weight, so instead of merging "the" 20 times, it's merged once with
+    // a weight of 20. A verse with every token counts to the number of them, though (as before only queries of more
+    // than 15 tokens were deduplicated) it's the number of distinct ones for long queries
+    int distinct = dedupe_tokens(tokens, num_tokens, token_counts, arena);
+    if (distinct < 0) {
+        printf("Internal allocation error\n");
+        // Nothing may be searched (or cached) for a half-prepared query
+        query->key = NULL;
+        return -1;
+    }
+    query->target = num_tokens > 15 ? distinct : num_tokens;
+
+    // Term ID of each token, found once for every table searched. Those no table has can't count towards anything
+    int num_terms = 0,
+        num_prefixes = 0;
+    for (int i = 0; i < distinct; i++) {
+        if (tokens[i].prefix) {
+            prefixes[num_prefixes] = tokens[i];
+            prefix_counts[num_prefixes++] = token_counts[i];
+            continue;
+        }
+        uint32_t term = find_term_hashed(&self->dictionary, tokens[i].text, tokens[i].hash);
+        if (term != NO_TERM) {
+            terms[num_terms] = term;
+            token_counts[num_terms++] = token_counts[i];
+        }
+    }
+
+    query->terms = terms;
+    query->token_counts = token_counts;
+    query->num_tokens = num_terms;
+    query->prefixes = prefixes;
+    query->prefix_counts = prefix_counts;
+    query->num_prefixes = num_prefixes;
+    return 0;
+}
+
+// Get the tables a version searches, the language's, its own, and any combined index's, returning how many
+static int version_tables(SearchObject *self, triple table_index, const struct term_table **tables) {
+    tables[0] = self->tables[table_index.lang];
+    tables[1] = self->tables[table_index.a];
+    tables[2] = self->tables[table_index.b];
+    // There's no combined index if `b` is 0
+    return table_index.b ? 3 : 2;
+}
+
+/*
+ * Add a term's lists in the version's tables (the language's, the version's own, and any combined index's) to
+ * `sources`, under the read lock, as those of token `token` counted `weight` times.
+ */
+static void add_term_sources(SearchObject *self, uint32_t term, triple table_index, int weight, int token,
+                             struct merge_source *sources, int *num_sources) {
+    const struct term_table *tables[3];
+    int num_tables = version_tables(self, table_index, tables);
+    for (int t = 0; t < num_tables; t++) {
+        const struct term_table *table = tables[t];
+        const struct posting_list *list = get_posting_list(table, term);
+        if (list != NULL) {
+            sources[(*num_sources)++] = (struct merge_source) {get_list_postings(table, list), list->length, weight, token};
+        }
+    }
+}
+
+/*
+ * Count the references of a prepared query in the version's tables and rank them, under the read lock.
+ * Returns the number of results in `*results`, and their counts in `*counts` unless `counts` is NULL, both in the
+ * scratch's arena.
+ */
+static Py_ssize_t search_query_tables(SearchObject *self, const struct search_query *query, triple table_index,
+                                      Py_ssize_t max_results, struct search_scratch *scratch,
+                                      uint32_t **results, uint32_t **counts) {
+    struct arena *arena = &scratch->arena;
+    int num_tokens = query->num_tokens;
+
+    // Queries asked for recently enough are ranked already
+    uint8_t tables[3] = {(uint8_t) table_index.lang, (uint8_t) table_index.a, (uint8_t) table_index.b};
+    int cacheable = query->key != NULL && counts == NULL && max_results > 0;
+    if (cacheable) {
+        Py_ssize_t cached = -1;
+        PyThread_acquire_lock(self->cache_lock, WAIT_LOCK);
+        if (self->cache.max_bytes) {
+            cached = cache_lookup(&self->cache, tables, query->key, query->key_length, max_results, results, arena);
+        }
+        PyThread_release_lock(self->cache_lock);
+        if (cached >= 0) {
+            return cached;
+        }
+    }
 
     // Pointers to the C lists of results
     result_pair *token_result_list = NULL;
@@ -741,220 +792,906 @@ PyObject *SearchObject_search(SearchObject *self, PyObject *args) {
     size_t result_count = 0,            // Current number of results
            token_result_list_len = 0;   // Allocated length of the result list
 
-    // Temporary result pointers
-    struct element *result_all = NULL,         // Results of all versions
-                   *result_version = NULL,     // Results of the particular version
-                   *result_combined = NULL;    // Results from any combined index (if applicable)
-
-    // If the version is invalid, return. Just in case something is wrong in the Python adapter
-    if (!table_index.a) {
-        free(tokens);
-        return PyList_New(0);
+    // Up to one list to merge from each table for every token, and one for every prefix
+    struct merge_source *sources = (struct merge_source *)arena_alloc(arena, (num_tokens * 3 + query->num_prefixes) * sizeof(struct merge_source));
+    int num_sources = 0;
+    if (sources == NULL) {
+        printf("Internal allocation error\n");
+        cacheable = 0;
+        goto rank_results;
     }
 
-    // Make sure we have tokens, then search
-    if (num_tokens > 15) {
-        // For sufficiently large inputs (15 for now), find duplicate tokens. 
-        // So instead of merging articles like "the" 20 times, we do it once and multiply by 20.
-        int *token_counts = (int *)malloc(num_tokens * sizeof(int));
-        for (int i = 0; i < num_tokens; i++)
-        {
-            // Since tokens is over allocated, we can just stop at the first NULL
-            if (tokens[i] == NULL) {
-                break;
-            }
-            token_counts[i] = 1;
-            for (int j = i + 1; j < num_tokens; j++) {
-                if (tokens[j] != NULL && strcmp(tokens[i], tokens[j]) == 0) {
-                    token_counts[i]++;
-                    free(tokens[j]);
-                    for (int k = j; k < num_tokens - 1; k++) {
-                        tokens[k] = tokens[k + 1];
-                    }
-                    num_tokens--;
-                    tokens[num_tokens] = NULL;
-                }
+    for (int i = 0; i < num_tokens; i++) {
+        add_term_sources(self, query->terms[i], table_index, query->token_counts[i], i, sources, &num_sources);
+    }
+    if (query->num_prefixes) {
+        const struct term_table *searched[3];
+        int num_searched = version_tables(self, table_index, searched);
+        for (int i = 0; i < query->num_prefixes; i++) {
+            const struct query_token *prefix = &query->prefixes[i];
+            int found = prefix_source(searched, num_searched, &self->dictionary, prefix->text, prefix->length,
+                                      query->prefix_counts[i], num_tokens + i, &sources[num_sources], arena);
+            if (found < 0) {
+                printf("Internal allocation error\n");
+                cacheable = 0;
+                goto rank_results;
             }
+            num_sources += found;
         }
+    }
 
-        for (int i = 0; i < num_tokens; i++) {
-            // Get results for all, adding to the number of total results
-            result_all = get_element(self->ht[table_index.lang], tokens[i]);
-            token_result_list_len += result_all != NULL ? result_all->length : 0;
-
-            // Get results for the particular version, adding to the number of total results
-            result_version = get_element(self->ht[table_index.a], tokens[i]);
-            token_result_list_len += result_version != NULL ? result_version->length : 0;
-
-            // If there is a combined index, search that too
-            if (table_index.b) {
-                result_combined = get_element(self->ht[table_index.b], tokens[i]);
-                token_result_list_len += result_combined != NULL ? result_combined->length : 0;
-            }
-
-            // Copy previous token results
-            if (result_count && token_result_list_len > result_count) {
-                token_result_list = realloc(token_result_list, sizeof(result_pair) * token_result_list_len);
-                if (token_result_list == NULL) {
-                    printf("Internal allocation error\n");
-                    return PyList_New(0);
-                }
-            }
-            else if (token_result_list_len > 0 && token_result_list == NULL) {
-                // Allocate a temporary list of results
-                token_result_list = malloc(sizeof(result_pair) * token_result_list_len);
-                if (token_result_list == NULL) {
-                    printf("Internal allocation error\n");
-                    return PyList_New(0);
-                }
-            }
-
-            // Add results from all
-            if (result_all != NULL) {
-                // Merge results from all
-                result_count = merge_results_count(token_result_list, result_count, result_all->value, result_all->length, token_counts[i]);
-            }
-
-            // Get results for version:
-            if (result_version != NULL) {
-                // Merge results from this version
-                result_count = merge_results_count(token_result_list, result_count, result_version->value, result_version->length, token_counts[i]);
-            }
-
-            // If applicable, get results from extra index:
-            if (result_combined != NULL) {
-                // Merge any results from the extra index
-                result_count = merge_results_count(token_result_list, result_count, result_combined->value, result_combined->length, token_counts[i]);
-            }
-            token_result_list_len = result_count;
+    // Count everything at once into a list big enough for every reference to be distinct (plus one for accumulating)
+    for (int i = 0; i < num_sources; i++) {
+        token_result_list_len += sources[i].length;
+    }
+    token_result_list = arena_alloc(arena, sizeof(result_pair) * (token_result_list_len + 1));
+    if (token_result_list == NULL) {
+        printf("Internal allocation error\n");
+        cacheable = 0;
+    }
+    else {
+        Py_ssize_t top_count = -1;
+        // Searches for a few results only count the verses that could be among them
+        if (should_search_top(sources, num_sources, max_results)) {
+            top_count = top_postings(sources, num_sources, (uint_fast16_t) query->target, (size_t) max_results, token_result_list,
+                                     arena);
         }
-        // Free the dynamically allocated tokens
-        for (int i = 0; i < len_tokens; i++)
-        {
-            // Since tokens is over allocated, we can just stop at the first NULL
-            if (tokens[i] == NULL) {
-                break;
-            }
-            free(tokens[i]);
+        if (top_count >= 0) {
+            result_count = (size_t) top_count;
         }
-        // Free the list of tokens
-        free(tokens);
-    }
-    else if (tokens) {
-        for (int i = 0; i < num_tokens; i++) {
-            // Get results for all, adding to the number of total results
-            result_all = get_element(self->ht[table_index.lang], tokens[i]);
-            token_result_list_len += result_all != NULL ? result_all->length : 0;
-
-            // Get results for the particular version, adding to the number of total results
-            result_version = get_element(self->ht[table_index.a], tokens[i]);
-            token_result_list_len += result_version != NULL ? result_version->length : 0;
-
-            // If there is a combined index, search that too
-            if (table_index.b) {
-                result_combined = get_element(self->ht[table_index.b], tokens[i]);
-                token_result_list_len += result_combined != NULL ? result_combined->length : 0;
-            }
-
-            // Copy previous token results
-            if (result_count && token_result_list_len > result_count) {
-                token_result_list = realloc(token_result_list, sizeof(result_pair) * token_result_list_len);
-                if (token_result_list == NULL) {
-                    printf("Internal allocation error\n");
-                    return PyList_New(0);
-                }
-            }
-            else if (token_result_list_len > 0 && token_result_list == NULL) {
-                // Allocate a temporary list of results
-                token_result_list = malloc(sizeof(result_pair) * token_result_list_len);
-                if (token_result_list == NULL) {
-                    printf("Internal allocation error\n");
-                    return PyList_New(0);
-                }
-            }
-
-            // Add results from all
-            if (result_all != NULL) {
-                // Merge results from all
-                result_count = merge_results(token_result_list, result_count, result_all->value, result_all->length);
+        // Broad queries are counted per verse
+        else if (should_accumulate(sources, num_sources) && !prepare_accumulator(&scratch->accumulator)) {
+            result_count = accumulate_postings(&scratch->accumulator, sources, num_sources, token_result_list);
+        }
+        else {
+            ptrdiff_t merged = merge_postings(sources, num_sources, token_result_list, arena);
+            if (merged < 0) {
+                cacheable = 0;
             }
-
-            // Get results for version:
-            if (result_version != NULL) {
-                // Merge results from this version
-                result_count = merge_results(token_result_list, result_count, result_version->value, result_version->length);
+            else {
+                result_count = (size_t) merged;
             }
+        }
+    }
 
-            // If applicable, get results from extra index:
-            if (result_combined != NULL) {
-                // Merge any results from the extra index
-                result_count = merge_results(token_result_list, result_count, result_combined->value, result_combined->length);
-            }
-            token_result_list_len = result_count;
+rank_results:
+    // Rank the results, storing the length of the deduplicated portion of the array
+    token_result_list_longs = (uint32_t*) arena_alloc(arena, result_count * sizeof(uint32_t));
+    uint32_t *result_counts = NULL;
+    if (counts != NULL) {
+        result_counts = (uint32_t*) arena_alloc(arena, result_count * sizeof(uint32_t));
+    }
+    if (token_result_list_longs == NULL || (counts != NULL && result_counts == NULL)) {
+        result_count = 0;
+    }
+    else {
+        Py_ssize_t ranked = rank(token_result_list, result_count, query->target, max_results, token_result_list_longs,
+                                 result_counts, arena);
+        // What's left after a failure is no answer to the query, so it's never cached
+        if (ranked < 0) {
+            ranked = 0;
+            cacheable = 0;
         }
-        // Free the dynamically allocated tokens
-        for (int i = 0; i < len_tokens; i++)
-        {
-            // Since tokens is over allocated, we can just stop at the first NULL
-            if (tokens[i] == NULL) {
-                break;
+        result_count = (size_t) ranked;
+        if (cacheable) {
+            PyThread_acquire_lock(self->cache_lock, WAIT_LOCK);
+            if (self->cache.max_bytes) {
+                cache_insert(&self->cache, tables, query->key, query->key_length, max_results,
+                             token_result_list_longs, result_count);
             }
-            free(tokens[i]);
+            PyThread_release_lock(self->cache_lock);
         }
-        // Free the list of tokens
-        free(tokens);
     }
-    else {
-        // Raise exception?
-        printf("Failed to tokenize query\n");
-        PyObject *exception_type = PyExc_RuntimeError;
-        PyObject *exception_value = PyUnicode_FromString("Failed to tokenize query\n");
-        PyObject *exception_traceback = NULL;
-        PyErr_SetObject(exception_type, exception_value);
-
-        goto token_free;
+    *results = token_result_list_longs;
+    if (counts != NULL) {
+        *counts = result_counts;
     }
+    return (Py_ssize_t) result_count;
+}
 
-    // Rank the results, storing the length of the deduplicated portion of the array
-    token_result_list_longs = (uint32_t*) malloc(result_count * sizeof(uint32_t));
-    if (token_result_list_longs == NULL) {
-        goto token_free;
-    }
-    result_count = rank(token_result_list, result_count, num_tokens, max_results, token_result_list_longs);
-    // By this point: result_count <= token_result_list_len
-    if (max_results > result_count) {
-        max_results = result_count;
-    }
-
-    // Python list of results
-    PyObject* result_list = PyList_New(max_results);
-
-    for (size_t i = 0; i < max_results; i++) {
-        // Translate the reference and add it to the Python list
-        str_ref = rtranslate(token_result_list_longs[i]);
-        // Make sure the result isn't None. Basically another double check of the Python side of things.
-        if (str_ref != NULL) {
-            // Add the resulting Python string to the list
-            PyList_SET_ITEM(result_list, i, str_ref);
-        }
+/*
+ * The part of a search that only touches C data, so it runs without the GIL (under the read lock): tokenize the
+ * lowercase query, count the references of its tokens in the version's tables, and rank them, all in the scratch.
+ * Returns the number of results in `*results`, with their counts in `*counts` unless it's NULL, both in the scratch's
+ * arena, or -1 if the query couldn't be tokenized.
+ */
+static Py_ssize_t search_tables(SearchObject *self, const char *query_string, triple table_index,
+                                Py_ssize_t max_results, struct search_scratch *scratch, uint32_t **results,
+                                uint32_t **counts) {
+    struct search_query query;
+    if (prepare_query(self, query_string, &query, &scratch->arena)) {
+        return -1;
     }
+    return search_query_tables(self, &query, table_index, max_results, scratch, results, counts);
+}
 
-token_free:
-    // Free the dynamically allocated lists
-    if (token_result_list != NULL) {
-        free(token_result_list);
-    }
-    if (token_result_list_longs != NULL) {
-        free(token_result_list_longs);
+/*
+ * A read-only array of packed `uint32` values (verse IDs or their counts) from a search, exposed through the buffer
+ * protocol so that `memoryview` and `numpy.frombuffer` use it in place.
+ */
+typedef struct {
+    PyObject_HEAD
+    uint32_t *values;
+    Py_ssize_t length;
+    // The buffer's one dimension and its stride, pointed to by views
+    Py_ssize_t shape[1];
+    Py_ssize_t strides[1];
+} ResultArrayObject;
+
+static int ResultArray_getbuffer(ResultArrayObject *self, Py_buffer *view, int flags) {
+    if (flags & PyBUF_WRITABLE) {
+        PyErr_SetString(PyExc_BufferError, "Result arrays are read-only");
+        view->obj = NULL;
+        return -1;
     }
+    view->obj = (PyObject *) self;
+    Py_INCREF(self);
+    view->buf = self->values;
+    view->len = self->length * (Py_ssize_t) sizeof(uint32_t);
+    view->readonly = 1;
+    view->itemsize = sizeof(uint32_t);
+    view->format = (flags & PyBUF_FORMAT) ? "I" : NULL;
+    view->ndim = 1;
+    view->shape = (flags & PyBUF_ND) ? self->shape : NULL;
+    view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->strides : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    return 0;
+}
+
+static Py_ssize_t ResultArray_length(ResultArrayObject *self) {
+    return self->length;
+}
+
+static void ResultArray_destructor(ResultArrayObject *self) {
+    free(self->values);
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+static PyBufferProcs ResultArray_buffer = {
+    .bf_getbuffer = (getbufferproc)ResultArray_getbuffer,
+};
+
+static PySequenceMethods ResultArray_sequence = {
+    .sq_length = (lenfunc)ResultArray_length,
+};
+
+static PyTypeObject ResultArray = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "ResultArray",
+    .tp_doc = "Read-only packed uint32 search results",
+    .tp_basicsize = sizeof(ResultArrayObject),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_dealloc = (destructor)ResultArray_destructor,
+    .tp_as_buffer = &ResultArray_buffer,
+    .tp_as_sequence = &ResultArray_sequence,
+};
+
+// Copy `length` values into a new ResultArray
+static PyObject *results_to_array(const uint32_t *values, Py_ssize_t length) {
+    uint32_t *copy = (uint32_t *) malloc((length ? (size_t) length : 1) * sizeof(uint32_t));
+    if (copy == NULL) {
+        return PyErr_NoMemory();
+    }
+    if (length) {
+        memcpy(copy, values, (size_t) length * sizeof(uint32_t));
+    }
+    ResultArrayObject *array = PyObject_New(ResultArrayObject, &ResultArray);
+    if (array == NULL) {
+        free(copy);
+        return NULL;
+    }
+    array->values = copy;
+    array->length = length;
+    array->shape[0] = length;
+    array->strides[0] = sizeof(uint32_t);
+    return (PyObject *) array;
+}
+
+// Build the Python list of a search's results
+static PyObject *results_to_list(const uint32_t *results, Py_ssize_t result_count) {
+    PyObject* result_list = PyList_New(result_count);
+    if (result_list != NULL) {
+        for (Py_ssize_t i = 0; i < result_count; i++) {
+            // Translate the reference and add it to the Python list
+            PyObject* str_ref = rtranslate(results[i]);
+            // Make sure the result isn't None. Basically another double check of the Python side of things.
+            if (str_ref != NULL) {
+                // Add the resulting Python string to the list
+                PyList_SET_ITEM(result_list, i, str_ref);
+            }
+        }
+    }
+    return result_list;
+}
+
+/*
+ * Search the version's tables for a query string in the scratch, without the GIL, alongside other searches.
+ * The string belongs to Python, which keeps it as it is while the arguments hold on to it; tokenizing copies it.
+ * Returns the number of results like `search_tables`, or -1 with an exception set.
+ */
+static Py_ssize_t search_string(SearchObject *self, const char *query_string, triple table_index,
+                                Py_ssize_t max_results, struct search_scratch *scratch, uint32_t **results,
+                                uint32_t **counts) {
+    Py_ssize_t result_count;
+    Py_BEGIN_ALLOW_THREADS
+    rwlock_read(&self->lock);
+    result_count = search_tables(self, query_string, table_index, max_results, scratch, results, counts);
+    rwlock_read_unlock(&self->lock);
+    Py_END_ALLOW_THREADS
+
+    if (result_count < 0) {
+        PyErr_SetString(PyExc_RuntimeError, "Failed to tokenize query\n");
+    }
+    return result_count;
+}
+
+// Method to perform a search
+PyObject *SearchObject_search(SearchObject *self, PyObject *args) {
+    if (!self->tables) {
+        return PyList_New(0);
+    }
+    char *query1,     // The query string
+         *version;    // The version to query
+    // Maximum number of results to return to Python
+    Py_ssize_t max_results = PY_SSIZE_T_MAX;
+
+    if (!PyArg_ParseTuple(args, "ss|n", &query1, &version, &max_results)) {
+        PyObject *exception_type = PyExc_RuntimeError;
+        PyObject *exception_value = PyUnicode_FromString("Bad search arguments!\n");
+        PyObject *exception_traceback = NULL;
+        PyErr_SetObject(exception_type, exception_value);
+
+        // Return None just in case
+        Py_RETURN_NONE;
+    }
+    // Hash table indicies to get from
+    triple table_index = get_table_index(version);
+
+    // If the version is invalid, return. Just in case something is wrong in the Python adapter
+    if (!table_index.a) {
+        return PyList_New(0);
+    }
+
+    struct search_scratch *scratch = acquire_scratch(self);
+    if (scratch == NULL) {
+        return PyErr_NoMemory();
+    }
+    uint32_t *results = NULL;
+    Py_ssize_t result_count = search_string(self, query1, table_index, max_results, scratch, &results, NULL);
 
     // Give Python it's form of the results
+    PyObject* result_list = result_count < 0 ? NULL : results_to_list(results, result_count);
+    release_scratch(self, scratch);
+    return result_list;
+}
+
+/*
+ * Method to perform a search, returning the ranked verse IDs as a ResultArray instead of a list of strings,
+ * along with another of their counts if asked for.
+ */
+PyObject *SearchObject_search_ids(SearchObject *self, PyObject *args) {
+    char *query,      // The query string
+         *version;    // The version to query
+    Py_ssize_t max_results = PY_SSIZE_T_MAX;
+    int with_counts = 0;
+
+    if (!PyArg_ParseTuple(args, "ss|np", &query, &version, &max_results, &with_counts)) {
+        return NULL;
+    }
+    triple table_index = get_table_index(version);
+
+    struct search_scratch *scratch = acquire_scratch(self);
+    if (scratch == NULL) {
+        return PyErr_NoMemory();
+    }
+    uint32_t *results = NULL,
+             *counts = NULL;
+    Py_ssize_t result_count = 0;
+    PyObject *id_array = NULL,
+             *count_array = NULL,
+             *pair = NULL;
+    // Invalid versions have no results, like `search`
+    if (self->tables && table_index.a) {
+        result_count = search_string(self, query, table_index, max_results, scratch, &results,
+                                     with_counts ? &counts : NULL);
+        if (result_count < 0) {
+            goto ids_release;
+        }
+    }
+
+    id_array = results_to_array(results, result_count);
+    if (!with_counts || id_array == NULL) {
+        pair = id_array;
+        goto ids_release;
+    }
+    count_array = results_to_array(counts, result_count);
+    if (count_array == NULL) {
+        Py_DECREF(id_array);
+        goto ids_release;
+    }
+    pair = PyTuple_Pack(2, id_array, count_array);
+    Py_DECREF(id_array);
+    Py_DECREF(count_array);
+
+ids_release:
+    release_scratch(self, scratch);
+    return pair;
+}
+
+/*
+ * Find the verses with a phrase in a positional index, under the read lock. The phrase is tokenized like any query,
+ * less the tokens the index leaves out (single letters other than "a"), so that positions line up with the index's.
+ * Returns the number of verses in `*results`, in the arena, or -1 if memory runs out.
+ */
+static Py_ssize_t search_phrase_table(SearchObject *self, const char *phrase, const struct term_table *positions,
+                                      Py_ssize_t max_results, struct arena *arena, uint32_t **results) {
+    int num_tokens = 0;
+    struct query_token *tokens = tokenize_query(phrase, strlen(phrase), &num_tokens, arena);
+    if (tokens == NULL) {
+        return -1;
+    }
+    struct phrase_word *words = (struct phrase_word *) arena_alloc(arena, num_tokens * sizeof(struct phrase_word));
+    if (words == NULL) {
+        return -1;
+    }
+    int num_words = 0;
+    size_t room = SIZE_MAX;
+    for (int i = 0; i < num_tokens; i++) {
+        if (tokens[i].length == 1 && tokens[i].text[0] != 'a') {
+            continue;
+        }
+        uint32_t term = find_term_hashed(&self->dictionary, tokens[i].text, tokens[i].hash);
+        const struct posting_list *list = term != NO_TERM ? get_posting_list(positions, term) : NULL;
+        // A word the version doesn't have can't be in any of its phrases
+        if (list == NULL) {
+            return 0;
+        }
+        words[num_words] = (struct phrase_word) {get_list_positions(positions, list), list->length, (uint32_t) num_words, 0};
+        num_words++;
+        if (list->length < room) {
+            room = list->length;
+        }
+    }
+    if (num_words == 0 || max_results <= 0) {
+        return 0;
+    }
+    // Each verse is found once, at most as many as the rarest word is in
+    if ((size_t) max_results < room) {
+        room = (size_t) max_results;
+    }
+    *results = (uint32_t *) arena_alloc(arena, room * sizeof(uint32_t));
+    if (*results == NULL) {
+        return -1;
+    }
+    return (Py_ssize_t) phrase_postings(words, num_words, room, *results);
+}
+
+// Method to search for a phrase, its words next to each other and in order, in the version's positional index
+PyObject *SearchObject_search_phrase(SearchObject *self, PyObject *args) {
+    char *phrase,     // The phrase string
+         *version;    // The version to search
+    Py_ssize_t max_results = PY_SSIZE_T_MAX;
+
+    if (!PyArg_ParseTuple(args, "ss|n", &phrase, &version, &max_results)) {
+        return NULL;
+    }
+    triple table_index = get_table_index(version);
+    if (!self->tables || !table_index.a) {
+        return PyList_New(0);
+    }
+
+    struct search_scratch *scratch = acquire_scratch(self);
+    if (scratch == NULL) {
+        return PyErr_NoMemory();
+    }
+    uint32_t *results = NULL;
+    Py_ssize_t result_count = 0;
+    int loaded;
+    Py_BEGIN_ALLOW_THREADS
+    rwlock_read(&self->lock);
+    loaded = term_table_loaded(&self->positions[table_index.a]);
+    if (loaded) {
+        result_count = search_phrase_table(self, phrase, &self->positions[table_index.a], max_results,
+                                           &scratch->arena, &results);
+    }
+    rwlock_read_unlock(&self->lock);
+    Py_END_ALLOW_THREADS
+
+    PyObject *result_list = NULL;
+    if (!loaded) {
+        PyErr_Format(PyExc_RuntimeError, "Positions not loaded: %.80s", version);
+    }
+    else if (result_count < 0) {
+        PyErr_NoMemory();
+    }
+    else {
+        result_list = results_to_list(results, result_count);
+    }
+    release_scratch(self, scratch);
+    return result_list;
+}
+
+/*
+ * Add the lists of a token of a boolean query in the version's tables to `sources`, as those of token `index`: its
+ * term's, or for a prefix, the union of those of its terms. Returns 0 on success, or -1 if memory runs out.
+ */
+static int add_token_sources(SearchObject *self, const struct query_token *token, triple table_index, int index,
+                             struct merge_source *sources, int *num_sources, struct arena *arena) {
+    if (token->prefix) {
+        const struct term_table *searched[3];
+        int num_searched = version_tables(self, table_index, searched);
+        int found = prefix_source(searched, num_searched, &self->dictionary, token->text, token->length, 1, index,
+                                  &sources[*num_sources], arena);
+        if (found < 0) {
+            return -1;
+        }
+        *num_sources += found;
+        return 0;
+    }
+    uint32_t term = find_term_hashed(&self->dictionary, token->text, token->hash);
+    if (term != NO_TERM) {
+        add_term_sources(self, term, table_index, 1, index, sources, num_sources);
+    }
+    return 0;
+}
+
+// Whether a token of a query is excluded, written as `-token` at the start of a word
+static int token_excluded(const char *query_string, const struct query_token *token) {
+    uint32_t start = token->start;
+    return start > 0 && query_string[start - 1] == '-' &&
+           (start == 1 || isspace((unsigned char) query_string[start - 2]));
+}
+
+/*
+ * Find the verses of a boolean query in the version's tables, under the read lock: every token is required but those
+ * written as `-token`, which are excluded. Returns the number of verses in `*results`, in the arena, or -1 if memory
+ * runs out.
+ */
+static Py_ssize_t search_boolean_tables(SearchObject *self, const char *query_string, triple table_index,
+                                        Py_ssize_t max_results, struct arena *arena, uint32_t **results) {
+    int num_tokens = 0;
+    struct query_token *tokens = tokenize_query(query_string, strlen(query_string), &num_tokens, arena);
+    if (tokens == NULL) {
+        return -1;
+    }
+    // The required tokens, then the excluded ones, each without repeats
+    struct query_token *excluded = (struct query_token *) arena_alloc(arena, num_tokens * sizeof(struct query_token));
+    int *weights = (int *) arena_alloc(arena, num_tokens * sizeof(int));
+    struct merge_source *sources = (struct merge_source *) arena_alloc(arena, num_tokens * 3 * sizeof(struct merge_source));
+    if (excluded == NULL || weights == NULL || sources == NULL) {
+        return -1;
+    }
+    int num_required = 0,
+        num_excluded = 0;
+    for (int i = 0; i < num_tokens; i++) {
+        if (token_excluded(query_string, &tokens[i])) {
+            excluded[num_excluded++] = tokens[i];
+        }
+        else {
+            tokens[num_required++] = tokens[i];
+        }
+    }
+    num_required = dedupe_tokens(tokens, num_required, weights, arena);
+    num_excluded = dedupe_tokens(excluded, num_excluded, weights, arena);
+    if (num_required < 0 || num_excluded < 0) {
+        return -1;
+    }
+    // Excluding from nothing leaves nothing
+    if (num_required == 0) {
+        return 0;
+    }
+
+    int num_sources = 0;
+    size_t room = (size_t) max_results;
+    for (int i = 0; i < num_required; i++) {
+        int first = num_sources;
+        if (add_token_sources(self, &tokens[i], table_index, i, sources, &num_sources, arena)) {
+            return -1;
+        }
+        // A token the version doesn't have is in none of its verses
+        if (num_sources == first) {
+            return 0;
+        }
+        size_t length = 0;
+        for (int s = first; s < num_sources; s++) {
+            length += sources[s].length;
+        }
+        if (length < room) {
+            room = length;
+        }
+    }
+    // Those that no table has exclude nothing
+    int num_terms = num_required;
+    for (int i = 0; i < num_excluded; i++) {
+        int first = num_sources;
+        if (add_token_sources(self, &excluded[i], table_index, num_terms, sources, &num_sources, arena)) {
+            return -1;
+        }
+        num_terms += num_sources > first;
+    }
+
+    *results = (uint32_t *) arena_alloc(arena, room * sizeof(uint32_t));
+    if (*results == NULL) {
+        return -1;
+    }
+    return boolean_postings(sources, num_sources, num_required, num_terms - num_required, room, *results, arena);
+}
+
+/*
+ * Method to search for the verses with every word of a query but those written as `-word`, which they must not have,
+ * in verse order
+ */
+PyObject *SearchObject_search_boolean(SearchObject *self, PyObject *args) {
+    char *query,      // The query string
+         *version;    // The version to query
+    Py_ssize_t max_results = PY_SSIZE_T_MAX;
+
+    if (!PyArg_ParseTuple(args, "ss|n", &query, &version, &max_results)) {
+        return NULL;
+    }
+    triple table_index = get_table_index(version);
+    if (!self->tables || !table_index.a || max_results <= 0) {
+        return PyList_New(0);
+    }
+
+    struct search_scratch *scratch = acquire_scratch(self);
+    if (scratch == NULL) {
+        return PyErr_NoMemory();
+    }
+    uint32_t *results = NULL;
+    Py_ssize_t result_count;
+    Py_BEGIN_ALLOW_THREADS
+    rwlock_read(&self->lock);
+    result_count = search_boolean_tables(self, query, table_index, max_results, &scratch->arena, &results);
+    rwlock_read_unlock(&self->lock);
+    Py_END_ALLOW_THREADS
+
+    PyObject *result_list = result_count < 0 ? PyErr_NoMemory() : results_to_list(results, result_count);
+    release_scratch(self, scratch);
     return result_list;
 }
 
+// Most threads a batch of searches is spread over
+#define SEARCH_MAX_THREADS 64
+
+/*
+ * A batch of searches, spread over worker threads that each take the next search until there are none left.
+ * Either many queries in one version, or one query in many versions.
+ * They all run under the read lock of the thread that started them, without the GIL.
+ */
+struct search_batch
+{
+    SearchObject *self;
+    triple table_index;
+    Py_ssize_t max_results;
+    // The lowercase queries, or else the one prepared query, searched in each of `table_indices` instead
+    char **queries;
+    const struct search_query *query;
+    triple *table_indices;
+    // The results and number of results of each search (-1 if it couldn't be tokenized, -2 if memory ran out)
+    uint32_t **results;
+    Py_ssize_t *counts;
+    Py_ssize_t num_queries;
+    // Guards the next query to take and the number of workers still running
+    PyThread_type_lock lock;
+    Py_ssize_t next;
+    int running;
+    // Held until the last worker finishes
+    PyThread_type_lock done;
+};
+
+static void search_batch_worker(void *arg) {
+    struct search_batch *batch = (struct search_batch *) arg;
+    // Every worker searches in its own scratch, kept for all of its queries
+    struct search_scratch *scratch = acquire_scratch(batch->self);
+    for (;;) {
+        PyThread_acquire_lock(batch->lock, WAIT_LOCK);
+        Py_ssize_t i = batch->next++;
+        PyThread_release_lock(batch->lock);
+        if (i >= batch->num_queries) {
+            break;
+        }
+        if (scratch == NULL) {
+            batch->counts[i] = -2;
+            continue;
+        }
+        uint32_t *results = NULL;
+        Py_ssize_t count = 0;
+        if (batch->query != NULL) {
+            // Versions that don't exist have no results
+            if (batch->table_indices[i].a) {
+                count = search_query_tables(batch->self, batch->query, batch->table_indices[i], batch->max_results,
+                                            scratch, &results, NULL);
+            }
+        }
+        else {
+            count = search_tables(batch->self, batch->queries[i], batch->table_index, batch->max_results, scratch,
+                                  &results, NULL);
+        }
+        // The results outlive the scratch's memory, which is let go of for the next query
+        if (count > 0) {
+            batch->results[i] = (uint32_t *) malloc((size_t) count * sizeof(uint32_t));
+            if (batch->results[i] == NULL) {
+                count = -2;
+            }
+            else {
+                memcpy(batch->results[i], results, (size_t) count * sizeof(uint32_t));
+            }
+        }
+        batch->counts[i] = count;
+        arena_reset(&scratch->arena);
+    }
+    if (scratch != NULL) {
+        release_scratch(batch->self, scratch);
+    }
+
+    PyThread_acquire_lock(batch->lock, WAIT_LOCK);
+    int last = --batch->running == 0;
+    PyThread_release_lock(batch->lock);
+    // The batch is freed as soon as this is released, so it's the last thing touched
+    if (last) {
+        PyThread_release_lock(batch->done);
+    }
+}
+
+/*
+ * Run every search of a batch over up to `num_threads` threads, counting the calling thread.
+ * Call without the GIL, holding the read lock.
+ */
+static void run_search_batch(struct search_batch *batch, int num_threads) {
+    if (num_threads > SEARCH_MAX_THREADS) {
+        num_threads = SEARCH_MAX_THREADS;
+    }
+    if (num_threads > batch->num_queries) {
+        num_threads = (int) batch->num_queries;
+    }
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+    PyThread_acquire_lock(batch->done, WAIT_LOCK);
+    batch->next = 0;
+    batch->running = num_threads;
+    for (int i = 1; i < num_threads; i++) {
+        // Fewer threads only make it slower
+        if (PyThread_start_new_thread(search_batch_worker, batch) == PYTHREAD_INVALID_THREAD_ID) {
+            PyThread_acquire_lock(batch->lock, WAIT_LOCK);
+            batch->running--;
+            PyThread_release_lock(batch->lock);
+        }
+    }
+    search_batch_worker(batch);
+    // Wait for the others
+    PyThread_acquire_lock(batch->done, WAIT_LOCK);
+    PyThread_release_lock(batch->done);
+}
+
+// Method to perform many searches of one version at once, over several threads
+PyObject *SearchObject_search_many(SearchObject *self, PyObject *args) {
+    PyObject *query_objects;    // Sequence of query strings
+    char *version;              // The version to query
+    Py_ssize_t max_results = PY_SSIZE_T_MAX;
+    int num_threads = 1;        // Threads to search with, counting this one
+
+    if (!PyArg_ParseTuple(args, "Os|ni", &query_objects, &version, &max_results, &num_threads)) {
+        return NULL;
+    }
+    PyObject *sequence = PySequence_Fast(query_objects, "Queries must be a sequence of strings");
+    if (sequence == NULL) {
+        return NULL;
+    }
+    Py_ssize_t num_queries = PySequence_Fast_GET_SIZE(sequence);
+    triple table_index = get_table_index(version);
+
+    struct search_batch batch = {self, table_index, max_results, NULL, NULL, NULL, NULL, NULL, num_queries, NULL, 0, 0,
+                                 NULL};
+    size_t length = num_queries ? (size_t) num_queries : 1;
+    batch.queries = (char **) calloc(length, sizeof(char *));
+    batch.results = (uint32_t **) calloc(length, sizeof(uint32_t *));
+    batch.counts = (Py_ssize_t *) calloc(length, sizeof(Py_ssize_t));
+    batch.lock = PyThread_allocate_lock();
+    batch.done = PyThread_allocate_lock();
+    PyObject *result_lists = NULL;
+    if (batch.queries == NULL || batch.results == NULL || batch.counts == NULL || batch.lock == NULL ||
+        batch.done == NULL) {
+        PyErr_NoMemory();
+        goto batch_free;
+    }
+
+    // Copies of the queries, as the sequence may change while they're searched
+    for (Py_ssize_t i = 0; i < num_queries; i++) {
+        PyObject *query_object = PySequence_Fast_GET_ITEM(sequence, i);
+        if (!PyUnicode_Check(query_object)) {
+            PyErr_Format(PyExc_TypeError, "Query %zd is not a string", i);
+            goto batch_free;
+        }
+        Py_ssize_t query_length;
+        const char *query = PyUnicode_AsUTF8AndSize(query_object, &query_length);
+        if (query == NULL) {
+            goto batch_free;
+        }
+        batch.queries[i] = (char *) malloc((size_t) query_length + 1);
+        if (batch.queries[i] == NULL) {
+            PyErr_NoMemory();
+            goto batch_free;
+        }
+        memcpy(batch.queries[i], query, (size_t) query_length + 1);
+    }
+
+    // Invalid versions have no results, like `search`
+    if (self->tables && table_index.a && num_queries) {
+        Py_BEGIN_ALLOW_THREADS
+        rwlock_read(&self->lock);
+        run_search_batch(&batch, num_threads);
+        rwlock_read_unlock(&self->lock);
+        Py_END_ALLOW_THREADS
+    }
+
+    for (Py_ssize_t i = 0; i < num_queries; i++) {
+        if (batch.counts[i] == -2) {
+            PyErr_NoMemory();
+            goto batch_free;
+        }
+        if (batch.counts[i] < 0) {
+            PyErr_Format(PyExc_RuntimeError, "Failed to tokenize query %zd", i);
+            goto batch_free;
+        }
+    }
+    result_lists = PyList_New(num_queries);
+    if (result_lists == NULL) {
+        goto batch_free;
+    }
+    for (Py_ssize_t i = 0; i < num_queries; i++) {
+        PyObject *result_list = results_to_list(batch.results[i], batch.counts[i]);
+        if (result_list == NULL) {
+            Py_CLEAR(result_lists);
+            break;
+        }
+        PyList_SET_ITEM(result_lists, i, result_list);
+    }
+
+batch_free:
+    for (Py_ssize_t i = 0; i < num_queries; i++) {
+        if (batch.queries != NULL) {
+            free(batch.queries[i]);
+        }
+        if (batch.results != NULL) {
+            free(batch.results[i]);
+        }
+    }
+    free(batch.queries);
+    free(batch.results);
+    free(batch.counts);
+    if (batch.lock != NULL) {
+        PyThread_free_lock(batch.lock);
+    }
+    if (batch.done != NULL) {
+        PyThread_free_lock(batch.done);
+    }
+    Py_DECREF(sequence);
+    return result_lists;
+}
+
+// Method to search one query in many versions at once, over several threads
+PyObject *SearchObject_search_versions(SearchObject *self, PyObject *args) {
+    char *query_string;         // The query string
+    PyObject *version_objects;  // Sequence of the versions to query
+    Py_ssize_t max_results = PY_SSIZE_T_MAX;
+    int num_threads = 1;        // Threads to search with, counting this one
+
+    if (!PyArg_ParseTuple(args, "sO|ni", &query_string, &version_objects, &max_results, &num_threads)) {
+        return NULL;
+    }
+    PyObject *sequence = PySequence_Fast(version_objects, "Versions must be a sequence of strings");
+    if (sequence == NULL) {
+        return NULL;
+    }
+    Py_ssize_t num_versions = PySequence_Fast_GET_SIZE(sequence);
+
+    struct search_batch batch = {self, {0, 0, 0}, max_results, NULL, NULL, NULL, NULL, NULL, num_versions, NULL, 0, 0,
+                                 NULL};
+    size_t length = num_versions ? (size_t) num_versions : 1;
+    batch.table_indices = (triple *) calloc(length, sizeof(triple));
+    batch.results = (uint32_t **) calloc(length, sizeof(uint32_t *));
+    batch.counts = (Py_ssize_t *) calloc(length, sizeof(Py_ssize_t));
+    batch.lock = PyThread_allocate_lock();
+    batch.done = PyThread_allocate_lock();
+    PyObject *result_lists = NULL;
+    if (batch.table_indices == NULL || batch.results == NULL || batch.counts == NULL || batch.lock == NULL ||
+        batch.done == NULL) {
+        PyErr_NoMemory();
+        goto versions_free;
+    }
+
+    for (Py_ssize_t i = 0; i < num_versions; i++) {
+        PyObject *version_object = PySequence_Fast_GET_ITEM(sequence, i);
+        if (!PyUnicode_Check(version_object)) {
+            PyErr_Format(PyExc_TypeError, "Version %zd is not a string", i);
+            goto versions_free;
+        }
+        const char *version = PyUnicode_AsUTF8(version_object);
+        if (version == NULL) {
+            goto versions_free;
+        }
+        batch.table_indices[i] = get_table_index(version);
+    }
+
+    // The query is tokenized and looked up once, then searched in every version at once
+    int error = 0;
+    if (self->tables && num_versions) {
+        struct search_query prepared;
+        Py_BEGIN_ALLOW_THREADS
+        // The prepared query lives in a scratch of its own, as the workers reset theirs between versions
+        struct search_scratch *scratch = acquire_scratch(self);
+        if (scratch == NULL) {
+            error = -2;
+        }
+        else {
+            rwlock_read(&self->lock);
+            error = prepare_query(self, query_string, &prepared, &scratch->arena);
+            if (!error) {
+                batch.query = &prepared;
+                run_search_batch(&batch, num_threads);
+            }
+            rwlock_read_unlock(&self->lock);
+            release_scratch(self, scratch);
+        }
+        Py_END_ALLOW_THREADS
+    }
+    if (error == -2) {
+        PyErr_NoMemory();
+        goto versions_free;
+    }
+    if (error) {
+        PyErr_SetString(PyExc_RuntimeError, "Failed to tokenize query\n");
+        goto versions_free;
+    }
+    for (Py_ssize_t i = 0; i < num_versions; i++) {
+        if (batch.counts[i] < 0) {
+            PyErr_NoMemory();
+            goto versions_free;
+        }
+    }
+
+    // Results by version, those that don't exist having none like `search`
+    result_lists = PyDict_New();
+    if (result_lists == NULL) {
+        goto versions_free;
+    }
+    for (Py_ssize_t i = 0; i < num_versions; i++) {
+        PyObject *result_list = results_to_list(batch.results[i], batch.counts[i]);
+        if (result_list == NULL || PyDict_SetItem(result_lists, PySequence_Fast_GET_ITEM(sequence, i), result_list)) {
+            Py_XDECREF(result_list);
+            Py_CLEAR(result_lists);
+            break;
+        }
+        Py_DECREF(result_list);
+    }
+
+versions_free:
+    if (batch.results != NULL) {
+        for (Py_ssize_t i = 0; i < num_versions; i++) {
+            free(batch.results[i]);
+        }
+    }
+    free(batch.table_indices);
+    free(batch.results);
+    free(batch.counts);
+    if (batch.lock != NULL) {
+        PyThread_free_lock(batch.lock);
+    }
+    if (batch.done != NULL) {
+        PyThread_free_lock(batch.done);
+    }
+    Py_DECREF(sequence);
+    return result_lists;
+}
+
 /* 
- * Load an index of either a version or multiple versions.
- * Ideally, this would take in a file name and just do the parsing *and* extraction work on the C side of things.
+ * Load an index of either a version or multiple versions from its decompressed JSON string.
+ * Callers should prefer `load_file`, which decompresses and parses the file on the C side of things, or `load_index`
+ * for a binary index. This is the fallback for builds without bzip2, where Python decompresses the file instead.
  */ 
 PyObject *SearchObject_load(SearchObject *self, PyObject *args) {
     const char *json,       // The JSON string
@@ -970,70 +1707,181 @@ PyObject *SearchObject_load(SearchObject *self, PyObject *args) {
         Py_RETURN_NONE;
     }
     // The index of the table to load into
-    short table_index;
-    // Check if the version is a combined index
-    if (!strcmp(version, "AllEng")) {
-        table_index = ENGLISH_ALL;
+    short table_index = get_load_index(version);
+    // Make sure that the version is valid
+    if (table_index < 0) {
+        return set_invalid_version(version);
     }
-    else if (!strcmp(version, "AllEs")) {
-        table_index = SPANISH_ALL;
+    if (term_table_loaded(self->tables[table_index])) {
+        Py_RETURN_NONE;
     }
-    else if (!strcmp(version, "KJV-like")) {
-        table_index = KJV_LIKE;
+
+    // Parse the input on the side without the GIL, like `load_file`. The string stays alive with `args`
+    struct hashtable table;
+    reset_table(&table);
+    int error;
+    Py_BEGIN_ALLOW_THREADS
+    error = parse_json(json, &table);
+    Py_END_ALLOW_THREADS
+    if (error) {
+        delete_table(&table);
+        if (error == JSON_ERROR_ALLOC) {
+            return PyErr_NoMemory();
+        }
+        PyErr_Format(PyExc_RuntimeError, "Reference outside the versification in the index of %.80s", version);
+        return NULL;
     }
-    else if (!strcmp(version, "NIV")) {
-        table_index = NIV;
+
+    return install_loaded_table(self, table_index, &table);
+}
+
+/*
+ * Load an index of either a version or multiple versions straight from its compressed JSON file.
+ * The file is decompressed and parsed in chunks without the GIL, so other threads can keep searching meanwhile.
+ */
+PyObject *SearchObject_load_file(SearchObject *self, PyObject *args) {
+    const char *path,       // Path of the compressed JSON file
+               *version;    // The version string being loaded
+
+    if (!PyArg_ParseTuple(args, "ss", &path, &version)) {
+        return NULL;
     }
-    else if (!strcmp(version, "Literal")) {
-        table_index = LITERAL;
+    short table_index = get_load_index(version);
+    if (table_index < 0) {
+        return set_invalid_version(version);
     }
-    else if (!strcmp(version, "Literal2")) {
-        table_index = LITERAL2;
+    // Already loaded
+    if (term_table_loaded(self->tables[table_index])) {
+        Py_RETURN_NONE;
     }
-    else if (!strcmp(version, "Literal3")) {
-        table_index = LITERAL3;
+
+    // Build the table on the side, since searches may run while the GIL is released
+    struct hashtable table;
+    reset_table(&table);
+    int error;
+    Py_BEGIN_ALLOW_THREADS
+    error = load_json_file(path, &table);
+    Py_END_ALLOW_THREADS
+    if (error != INDEX_OK) {
+        delete_table(&table);
+        return set_index_error(error, path);
     }
-    else if (!strcmp(version, "Dynamic")) {
-        table_index = DYNAMIC;
+
+    return install_loaded_table(self, table_index, &table);
+}
+
+/*
+ * Load an index of either a version or multiple versions from a binary index file.
+ * The file is memory-mapped and its postings are used in place, so this is far cheaper than `load`.
+ */
+PyObject *SearchObject_load_index(SearchObject *self, PyObject *args) {
+    const char *path,       // Path of the index file
+               *version;    // The version string being loaded
+
+    if (!PyArg_ParseTuple(args, "ss", &path, &version)) {
+        return NULL;
     }
-    else if (!strcmp(version, "EsRV")) {
-        table_index = ES_RV;
+    short table_index = get_load_index(version);
+    if (table_index < 0) {
+        return set_invalid_version(version);
     }
-    else if (!strcmp(version, "ExtraEng")) {
-        table_index = EXTRA_ENG;
+    // Already loaded
+    if (term_table_loaded(self->tables[table_index])) {
+        Py_RETURN_NONE;
     }
-    // If not, use `get_table_index` to find the right one for this version
-    else {
-        table_index = get_table_index(version).a;
-        // Make sure that the version is valid
-        if (!table_index) {
-            // Raise an exception for the invalid version
-            printf("Error! %d\n", table_index);
-            char error_buff[100];
-            strncpy(error_buff, "Invalid version: ", sizeof(error_buff) - 1);
-            strncat(error_buff, version, sizeof(error_buff) - 1);
-            PyObject *exception_type = PyExc_RuntimeError;
-            PyObject *exception_value = PyUnicode_FromString(error_buff);
-            PyObject *exception_traceback = NULL;
-            PyErr_SetObject(exception_type, exception_value);
-
-            // Return None just in case
-            Py_RETURN_NONE;
-        }
+
+    struct hashtable table;
+    reset_table(&table);
+    int error = load_index_file(path, &table);
+    if (error != INDEX_OK) {
+        return set_index_error(error, path);
+    }
+    return install_loaded_table(self, table_index, &table);
+}
+
+/*
+ * Load a version's positional index, for phrase searches, from its compressed JSON file (`*.positions.json.pbz2`).
+ * Like `load_file`, it's decompressed and parsed without the GIL.
+ */
+PyObject *SearchObject_load_positions(SearchObject *self, PyObject *args) {
+    const char *path,       // Path of the compressed JSON file
+               *version;    // The version whose positions they are
+
+    if (!PyArg_ParseTuple(args, "ss", &path, &version)) {
+        return NULL;
+    }
+    // Only versions have positions, not the combined indices
+    short table_index = get_table_index(version).a;
+    if (!self->tables || !table_index) {
+        return set_invalid_version(version);
     }
-    if (self->ht[table_index]->size > 0) {
+    if (term_table_loaded(&self->positions[table_index])) {
         Py_RETURN_NONE;
     }
 
-    // Parse the input
-    parse_json(json, self->ht[table_index]);
-    
+    struct hashtable table;
+    reset_table(&table);
+    int error;
+    Py_BEGIN_ALLOW_THREADS
+    error = load_positions_file(path, &table);
+    Py_END_ALLOW_THREADS
+    if (error != INDEX_OK) {
+        delete_table(&table);
+        return set_index_error(error, path);
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    rwlock_write(&self->lock);
+    Py_END_ALLOW_THREADS
+    if (term_table_loaded(&self->positions[table_index])) {
+        delete_table(&table);
+    }
+    else if (install_table(&self->dictionary, &table, &self->positions[table_index])) {
+        delete_table(&table);
+        error = INDEX_ALLOC_ERROR;
+    }
+    rwlock_write_unlock(&self->lock);
+    if (error != INDEX_OK) {
+        return PyErr_NoMemory();
+    }
+    Py_RETURN_NONE;
+}
+
+// Save a loaded version's (or combined) index as a binary index file for `load_index`
+PyObject *SearchObject_save_index(SearchObject *self, PyObject *args) {
+    const char *version,    // The version string to save
+               *path;       // Path of the index file
+
+    if (!PyArg_ParseTuple(args, "ss", &version, &path)) {
+        return NULL;
+    }
+    short table_index = get_load_index(version);
+    if (table_index < 0) {
+        return set_invalid_version(version);
+    }
+    // Written out without the GIL, while the table can't be unloaded
+    int loaded, error = INDEX_OK;
+    Py_BEGIN_ALLOW_THREADS
+    rwlock_read(&self->lock);
+    loaded = term_table_loaded(self->tables[table_index]);
+    if (loaded) {
+        error = save_index_file(self->tables[table_index], &self->dictionary, path);
+    }
+    rwlock_read_unlock(&self->lock);
+    Py_END_ALLOW_THREADS
+    if (!loaded) {
+        PyErr_Format(PyExc_RuntimeError, "Version not loaded: %.80s", version);
+        return NULL;
+    }
+    if (error != INDEX_OK) {
+        return set_index_error(error, path);
+    }
     Py_RETURN_NONE;
 }
 
 PyObject *SearchObject_unload(SearchObject *self, PyObject *args) {
     // If the hashtable DNE, then just return
-    if (!self->ht) {
+    if (!self->tables) {
         Py_RETURN_NONE;
     }
     char* version;  // The version to unload
@@ -1064,24 +1912,71 @@ PyObject *SearchObject_unload(SearchObject *self, PyObject *args) {
         Py_RETURN_NONE;
     }
     // Just return none if there is nothing to free
-    if (self->ht[table_index] == NULL) {
+    if (self->tables[table_index] == NULL) {
         Py_RETURN_NONE;
     }
 
+    // Wait for any searches using it
+    Py_BEGIN_ALLOW_THREADS
+    rwlock_write(&self->lock);
+    Py_END_ALLOW_THREADS
+
     // Free the table's dynamically allocated memory
-    delete_table(self->ht[table_index]);
+    delete_term_table(self->tables[table_index]);
 
     // Zero out the relevant attributes for potential later use
-    self->ht[table_index]->elements = NULL;
-    self->ht[table_index]->size = 0;
-    self->ht[table_index]->num_elements = 0;
+    reset_term_table(self->tables[table_index]);
+    invalidate_cached_table(self, table_index);
+    // Its positions go with it
+    delete_term_table(&self->positions[table_index]);
+    reset_term_table(&self->positions[table_index]);
+
+    rwlock_write_unlock(&self->lock);
+    Py_RETURN_NONE;
+}
 
+// Cap the memory of the result cache, 0 disabling it
+PyObject *SearchObject_set_cache_size(SearchObject *self, PyObject *args) {
+    Py_ssize_t max_bytes;
+    if (!PyArg_ParseTuple(args, "n", &max_bytes)) {
+        return NULL;
+    }
+    if (max_bytes < 0) {
+        PyErr_SetString(PyExc_ValueError, "The cache size can't be negative");
+        return NULL;
+    }
+    int error;
+    // Searches hold the lock without the GIL
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(self->cache_lock, WAIT_LOCK);
+    error = set_cache_size(&self->cache, (size_t) max_bytes);
+    PyThread_release_lock(self->cache_lock);
+    Py_END_ALLOW_THREADS
+    if (error) {
+        return PyErr_NoMemory();
+    }
     Py_RETURN_NONE;
 }
 
+// Get the result cache's counters, to size it
+PyObject *SearchObject_cache_info(SearchObject *self, PyObject *args) {
+    struct result_cache cache;
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(self->cache_lock, WAIT_LOCK);
+    cache = self->cache;
+    PyThread_release_lock(self->cache_lock);
+    Py_END_ALLOW_THREADS
+    return Py_BuildValue("{s:K,s:K,s:n,s:n,s:n}",
+                         "hits", (unsigned long long) cache.hits,
+                         "misses", (unsigned long long) cache.misses,
+                         "entries", (Py_ssize_t) cache.num_entries,
+                         "bytes", (Py_ssize_t) cache.bytes,
+                         "max_bytes", (Py_ssize_t) cache.max_bytes);
+}
+
 PyObject *SearchObject_index_size(SearchObject *self, PyObject *args) {
     // If the hashtable DNE, then just return
-    if (!self->ht) {
+    if (!self->tables) {
         Py_RETURN_NONE;
     }
     // Accumulator for the number of bytes here
@@ -1089,22 +1984,26 @@ PyObject *SearchObject_index_size(SearchObject *self, PyObject *args) {
     // Loop through each table
     for (int i = 0; i < NUM_TABLES; i++) {
         // If the table is not allocated, just skip that
-        if (self->ht[i] == NULL) {
+        if (self->tables[i] == NULL) {
             continue;
         }
-        // Loop through all of the elements
-        for (size_t j = 0; j < self->ht[i]->size; j++) {
-            if (self->ht[i]->elements[j] != NULL) {
-                // Add the size of the struct itself
-                num_bytes += sizeof(struct element);
-                // Also add the size of the array pointed to by the element
-                num_bytes += self->ht[i]->elements[j]->length * sizeof(uint32_t);
-            }
-        }
-        // Add the size of the hash table's array of elements
-        num_bytes += self->ht[i]->size * sizeof(struct element*);
+        // Add the size of the term ID map and the posting lists it points to
+        num_bytes += self->tables[i]->num_terms * sizeof(uint32_t);
+        num_bytes += self->tables[i]->num_lists * sizeof(struct posting_list);
+        // Its terms in key order
+        num_bytes += self->tables[i]->num_lists * sizeof(uint32_t);
+        // Also add the size of the encoded references of the lists
+        num_bytes += self->tables[i]->postings_size;
+        // And of any positional index
+        num_bytes += self->positions[i].num_terms * sizeof(uint32_t);
+        num_bytes += self->positions[i].num_lists * sizeof(struct posting_list);
+        num_bytes += self->positions[i].postings_size;
     }
-    num_bytes += sizeof(struct hashtable) * NUM_TABLES;
+    num_bytes += sizeof(struct term_table) * NUM_TABLES;
+    // And the shared dictionary's keys, and its slots or perfect hash
+    num_bytes += self->dictionary.num_elements * sizeof(struct element);
+    num_bytes += self->dictionary.size * sizeof(struct slot);
+    num_bytes += (self->dictionary.lookup.num_buckets + self->dictionary.lookup.size) * sizeof(uint32_t);
     // The object's struct size is included in the definition of the object, which will be read by Python, so I won't add that here as well
     return PyLong_FromSize_t(num_bytes);
 }
@@ -1112,9 +2011,20 @@ PyObject *SearchObject_index_size(SearchObject *self, PyObject *args) {
 // Method definitions
 static PyMethodDef SearchObject_methods[] = {
     {"search", (PyCFunction)SearchObject_search, METH_VARARGS, "Search method"},
+    {"search_ids", (PyCFunction)SearchObject_search_ids, METH_VARARGS, "Search method returning verse IDs"},
+    {"search_many", (PyCFunction)SearchObject_search_many, METH_VARARGS, "Search many queries over threads method"},
+    {"search_versions", (PyCFunction)SearchObject_search_versions, METH_VARARGS, "Search many versions over threads method"},
+    {"search_phrase", (PyCFunction)SearchObject_search_phrase, METH_VARARGS, "Search for a phrase method"},
+    {"search_boolean", (PyCFunction)SearchObject_search_boolean, METH_VARARGS, "Search for every word but excluded ones method"},
     {"load", (PyCFunction)SearchObject_load, METH_VARARGS, "Load dict method"},
+    {"load_file", (PyCFunction)SearchObject_load_file, METH_VARARGS, "Load compressed JSON file method"},
+    {"load_index", (PyCFunction)SearchObject_load_index, METH_VARARGS, "Load binary index file method"},
+    {"load_positions", (PyCFunction)SearchObject_load_positions, METH_VARARGS, "Load positional index file method"},
+    {"save_index", (PyCFunction)SearchObject_save_index, METH_VARARGS, "Save binary index file method"},
     {"unload", (PyCFunction)SearchObject_unload, METH_VARARGS, "Unload version method"},
     {"index_size", (PyCFunction)SearchObject_index_size, METH_VARARGS, "Gets the size of the index in bytes"},
+    {"set_cache_size", (PyCFunction)SearchObject_set_cache_size, METH_VARARGS, "Caps the result cache in bytes method"},
+    {"cache_info", (PyCFunction)SearchObject_cache_info, METH_NOARGS, "Gets the result cache counters"},
     {NULL} // Sentinel
 };
 
@@ -1151,14 +2061,21 @@ static PyModuleDef biblesearch = {
 // Module initialization entry point
 PyMODINIT_FUNC PyInit_multi_bible_search(void) {
     PyObject *m;
-    if (PyType_Ready(&BibleSearch) < 0) {
+    if (PyType_Ready(&BibleSearch) < 0 || PyType_Ready(&ResultArray) < 0) {
         return NULL;
     }
     m = PyModule_Create(&biblesearch);
     if (m == NULL) {
         return NULL;
     }
+    init_posting_tables();
+    init_merge_kernels();
+    init_accumulate_kernels();
+    init_tokenizer();
+    init_verse_tables();
     Py_INCREF(&BibleSearch);
     PyModule_AddObject(m, "BibleSearch", (PyObject *)&BibleSearch);
+    Py_INCREF(&ResultArray);
+    PyModule_AddObject(m, "ResultArray", (PyObject *)&ResultArray);
     return m;
 }
@@ -1,34 +1,154 @@
 """
 The C search engine implementation stub.
 """
-from typing import Optional
+from typing import Optional, Sequence, Union
 
-__all__ = ["BibleSearch"]
+__all__ = ["BibleSearch", "ResultArray"]
+
+
+class ResultArray:
+    """
+    Read-only packed `uint32` search results (verse IDs or their counts), exposing the buffer protocol so that
+    `memoryview` and `numpy.frombuffer` read them in place.
+    """
+    def __len__(self) -> int: ...
+    def __buffer__(self, flags: int) -> memoryview: ...
 
 
 class BibleSearch:
     """
     The C search engine for searching the Bible.
+
+    Searches release the GIL, so threads can search at once, and loading or unloading versions meanwhile is safe.
     """
     def __init__(self) -> None: ...
     def search(self, query: str, version: str, max_results: int = ...) -> Optional[list[str]]:
         """
         Search for a passage in the Bible.
+        :param query: The search query string. A word ending in `*` (e.g., `prophe*`) is a prefix, matching every
+        word that starts with it, and counts once for a verse with any of them.
+        :param version: The version to search.
+        :param max_results: The maximum number of results to retrieve. Small pages (up to 100) are found without
+        counting every verse of the query.
+        :return: List of match references (e.g., `["John 11:35", "Matthew 1:7", ...]`).
+        """
+        ...
+    def search_ids(self, query: str, version: str, max_results: int = ...,
+                   with_counts: bool = False) -> Union[ResultArray, tuple[ResultArray, ResultArray]]:
+        """
+        Search for a passage in the Bible, getting the verse IDs of the results instead of their references as strings.
         :param query: The search query string.
         :param version: The version to search.
         :param max_results: The maximum number of results to retrieve.
-        :return: List of match references (e.g., `["John 11:35", "Matthew 1:7", ...]`).
+        :param with_counts: Whether to also get how many of the query's tokens each result matched.
+        :return: The verse IDs in the order `search` returns their references, along with their counts if asked for.
+        """
+        ...
+    def search_many(self, queries: Sequence[str], version: str, max_results: int = ...,
+                    threads: int = 1) -> list[list[str]]:
+        """
+        Search for many passages in the same version at once, spreading the queries over `threads` native threads
+        (counting the calling one) that search without the GIL.
+        :param queries: The search query strings.
+        :param version: The version to search.
+        :param max_results: The maximum number of results to retrieve for each query.
+        :param threads: The number of threads to search with, up to 64.
+        :return: List of the results of each query, as `search` would return them.
+        :raises TypeError: If a query isn't a string.
+        """
+        ...
+    def search_versions(self, query: str, versions: Sequence[str], max_results: int = ...,
+                        threads: int = 1) -> dict[str, list[str]]:
+        """
+        Search for a passage in many versions at once. The query is tokenized and looked up once, then the versions
+        are spread over `threads` native threads (counting the calling one) that search without the GIL.
+        :param query: The search query string.
+        :param versions: The versions to search.
+        :param max_results: The maximum number of results to retrieve for each version.
+        :param threads: The number of threads to search with, up to 64.
+        :return: The results of each version, as `search` would return them.
+        :raises TypeError: If a version isn't a string.
+        """
+        ...
+    def search_boolean(self, query: str, version: str, max_results: int = ...) -> list[str]:
+        """
+        Search for the verses with every word of a query and none of those written as `-word` (at the start of a
+        word, so hyphenated words aren't excluded). Rather than counting every verse with any of the words, the lists
+        of the words are intersected from the rarest, skipping over whatever it doesn't have.
+        :param query: The search query string.
+        :param version: The version to search.
+        :param max_results: The maximum number of results to retrieve.
+        :return: List of match references, in verse order.
+        """
+        ...
+    def search_phrase(self, phrase: str, version: str, max_results: int = ...) -> list[str]:
+        """
+        Search for the verses with a phrase, its words next to each other and in order, in the version's positional
+        index (see `load_positions`). Single letters other than "a" aren't indexed, so they're skipped in the phrase.
+        :param phrase: The phrase string.
+        :param version: The version to search.
+        :param max_results: The maximum number of results to retrieve.
+        :return: List of match references, in verse order.
+        :raises RuntimeError: If the version's positions are not loaded.
         """
         ...
     def load(self, json: str, version: str) -> None:
         """
-        Load an index of either a version or multiple versions' combined index.
-        Ideally, this would take in a file name and just do the parsing *and* extraction work on
-        the C side of things in the future.
-        :param json: The version index string to preload.
+        Load an index of either a version or multiple versions' combined index from its decompressed
+        JSON string. Prefer `load_file` or `load_index`, which read the file on the C side of things;
+        this is the fallback for builds without bzip2.
+        :param json: The version index string to preload, mapping each token to the verse IDs
+        (or references, `book * 1_000_000 + chapter * 1_000 + verse`) it's in, in base 36.
         :param version: The name of the version being loaded.
         :returns: None.
-        :raises RuntimeError: For invalid version strings.
+        :raises RuntimeError: For invalid version strings or references that aren't verses.
+        """
+        ...
+    def load_file(self, path: str, version: str) -> None:
+        """
+        Load an index of either a version or multiple versions' combined index straight from its
+        compressed JSON file (`*.json.pbz2`). The file is decompressed and parsed in chunks
+        without holding the GIL.
+        :param path: Path of the compressed JSON index.
+        :param version: The name of the version being loaded.
+        :returns: None.
+        :raises OSError: If the file cannot be read.
+        :raises RuntimeError: For invalid version strings, malformed files, or if the module was
+        built without bzip2 support.
+        """
+        ...
+    def load_index(self, path: str, version: str) -> None:
+        """
+        Load an index of either a version or multiple versions' combined index from a binary
+        index file (see `save_index`). The file is memory-mapped and used in place.
+        :param path: Path of the binary index file.
+        :param version: The name of the version being loaded.
+        :returns: None.
+        :raises OSError: If the file cannot be read.
+        :raises RuntimeError: For invalid version strings or malformed/outdated index files.
+        """
+        ...
+    def load_positions(self, path: str, version: str) -> None:
+        """
+        Load a version's positional index from its compressed JSON file (`*.positions.json.pbz2`), mapping each token
+        to `verse_id * 1024 + position` (in base 36) for every place it is, a position counting the indexed tokens of
+        the verse. It's decompressed and parsed without holding the GIL, and unloaded along with the version.
+        :param path: Path of the compressed JSON positional index.
+        :param version: The name of the version (not a combined index) whose positions they are.
+        :returns: None.
+        :raises OSError: If the file cannot be read.
+        :raises RuntimeError: For invalid version strings, malformed files, or if the module was
+        built without bzip2 support.
+        """
+        ...
+    def save_index(self, version: str, path: str) -> None:
+        """
+        Save a loaded index as a binary index file for `load_index`.
+        :param version: The name of the version (or combined index) to save.
+        :param path: Where to write the binary index file.
+        :returns: None.
+        :raises OSError: If the file cannot be written.
+        :raises RuntimeError: For invalid version strings or versions that are not loaded.
         """
         ...
     def unload(self, version: str) -> None:
@@ -39,6 +159,22 @@ class BibleSearch:
         :raises RuntimeError: For invalid version strings.
         """
         ...
+    def set_cache_size(self, max_bytes: int) -> None:
+        """
+        Caps the memory of the cache of recent queries' ranked results, which is disabled (0) to begin with.
+        Queries are cached by their sorted tokens and version, and a version's entries are dropped whenever it or one
+        of the indices it's searched with is loaded or unloaded.
+        :param max_bytes: Memory in bytes the cache may use, or 0 to disable it.
+        :returns: None.
+        :raises ValueError: For negative sizes.
+        """
+        ...
+    def cache_info(self) -> dict[str, int]:
+        """
+        Gets the result cache's counters.
+        :return: The cache's `hits`, `misses`, `entries`, `bytes` used, and `max_bytes`.
+        """
+        ...
     def index_size(self) -> int:
         """
         Calculates the size of each hashtable in memory (in bytes)
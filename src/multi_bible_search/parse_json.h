@@ -6,30 +6,74 @@
 #include <string.h>
 #include <ctype.h>
 #include "hashtable.h"
+#include "verses.h"
+#include "positions.h"
 
 // Tell MSVC it's fine
 #pragma warning(disable : 4996)
 
 // Maximum length of the string of a token (the buffer size - 1)
 #define TOKEN_MAX_LENGTH 24
-#define REF_MIN_LEN 4
+// Verse IDs can be a single digit
+#define REF_MIN_LEN 1
 #define REF_NUM_BASE 36
 
+// Errors of the parsers
+#define JSON_ERROR_FORMAT 1
+#define JSON_ERROR_ALLOC 2
+
 // Count the number of a character in a string up to length
 static inline size_t char_count(const char *str, const char character, int len) {
     size_t count = 0;
     for (int i = 0; i < len; i++) {
         if (str[i] == character) {
             count++;
-            // Each reference is at least 4 characters long, so jump by that much.
+            // Each reference is at least REF_MIN_LEN characters long, so jump by that much.
             i += REF_MIN_LEN;
         }
     }
     return count;
 }
 
-// Function to parse the JSON
-static inline void parse_json(const char *json, struct hashtable *ht) {
+// Comparison function for sorting references
+static int compare_references(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *) a,
+             y = *(const uint32_t *) b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Sort a list of references and drop any duplicates, returning the new length.
+ * A few of the source texts have verses out of order (or repeated), but merging expects sorted, unique lists.
+ */
+static inline size_t normalize_references(uint32_t *values, size_t length) {
+    size_t i, k;
+    // Most lists are already in order, so only sort when needed
+    for (i = 1; i < length; i++) {
+        if (values[i] <= values[i - 1]) {
+            qsort(values, length, sizeof(uint32_t), compare_references);
+            break;
+        }
+    }
+    // Squeeze out duplicates
+    for (i = 1, k = length ? 1 : 0; i < length; i++) {
+        if (values[i] != values[k - 1]) {
+            values[k++] = values[i];
+        }
+    }
+    return k;
+}
+
+/*
+ * Function to parse the JSON.
+ * Returns 0 on success, JSON_ERROR_FORMAT if a reference isn't a verse, or JSON_ERROR_ALLOC if memory runs out.
+ */
+static inline int parse_json(const char *json, struct hashtable *ht) {
+    int error = 0;
+    // Size the table once for the number of arrays, which is the number of terms
+    if (!table_loaded(ht)) {
+        reserve_table(ht, char_count(json, '[', (int) strlen(json)));
+    }
     // Parse the JSON data
     char *ptr = json;
     while ((ptr = strchr(ptr, '\"')) != NULL) {
@@ -39,21 +83,19 @@ static inline void parse_json(const char *json, struct hashtable *ht) {
 
         // Length of the search token
         size_t token_length = token_end - token_start;
-        if (token_length > TOKEN_MAX_LENGTH) {
+        if (token_length > TOKEN_MAX_LENGTH || token_length >= KEY_SIZE) {
             break;
         }
 
-        // Temporary element to be added to the hashtable
-        struct element *e = (struct element *) malloc(sizeof(struct element));
-        // Copy the key to the element and null terminate it
-        strncpy(e->key, token_start, token_length);
-        e->key[token_length] = '\0';
+        // Copy the key and null terminate it
+        char key[KEY_SIZE];
+        memcpy(key, token_start, token_length);
+        key[token_length] = '\0';
 
         // Start of the array of references
         char *array_start = strchr(token_end + sizeof(char), '[');
-        // Each reference is at least 7 characters long, so jump by that much
         // End of the array of references
-        char *array_end = strchr(array_start + sizeof(char) * REF_MIN_LEN, ']');
+        char *array_end = strchr(array_start + sizeof(char), ']');
 
         // Skip the starting bracket itself
         array_start++;
@@ -65,6 +107,10 @@ static inline void parse_json(const char *json, struct hashtable *ht) {
 
         // Allocate the array of values based on the number of ',' separators + 1
         values = (uint32_t *) malloc((char_count(array_start, ',', array_end - array_start) + 1) * sizeof(uint32_t));
+        if (values == NULL) {
+            error = JSON_ERROR_ALLOC;
+            break;
+        }
 
         while (num_start < array_end) {
             // Convert the string to an unsigned long and add it to the array
@@ -75,18 +121,177 @@ static inline void parse_json(const char *json, struct hashtable *ht) {
             num_start = num_end + 1;
         }
 
-        // Add the array to the element
-        e->value = values;
-        e->length = array_size;
-
-        // Add the element to the hash table
-        add_element(ht, e);
+        if (to_verse_ids(values, array_size)) {
+            error = JSON_ERROR_FORMAT;
+            free(values);
+            break;
+        }
+        // Encode the array into the table's postings and add an element for it to the hash table
+        uint32_t length = (uint32_t) normalize_references(values, array_size),
+                 offset;
+        if (append_postings(ht, values, length, &offset) || add_element(ht, key, offset, length) == NULL) {
+            error = JSON_ERROR_ALLOC;
+            free(values);
+            break;
+        }
+        free(values);
 
         // Move ptr to the ',' at the end of the array. 
         ptr = array_end + 1;
     }
+    shrink_postings(ht);
+    return error;
+}
+
+
+// States of the incremental parser
+#define JSON_SEEK_KEY 0
+#define JSON_IN_KEY 1
+#define JSON_SEEK_ARRAY 2
+#define JSON_IN_ARRAY 3
+
+// State of an incremental parse, for JSON that arrives in chunks
+struct json_stream
+{
+    int state;
+    // The key being read
+    char key[TOKEN_MAX_LENGTH + 1];
+    size_t key_length;
+    // The references of the array being read
+    uint32_t *values;
+    size_t num_values;
+    size_t values_size;
+    // The reference being read, and whether any of its digits have been seen
+    uint32_t value;
+    int in_value;
+    // Set to one of the JSON_ERROR_* values on malformed input or allocation failure
+    int error;
+    // Whether the arrays are positional lists (see positions.h) rather than references
+    int positions;
+};
+
+// Start an incremental parse
+static inline void json_stream_init(struct json_stream *js) {
+    memset(js, 0, sizeof(struct json_stream));
+    js->state = JSON_SEEK_KEY;
+}
+
+// Release the incremental parser's buffer
+static inline void json_stream_free(struct json_stream *js) {
+    free(js->values);
+    js->values = NULL;
+}
+
+// Value of a base 36 digit, or -1 if it isn't one
+static inline int base36_digit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'A' && c <= 'Z') {
+        return c - 'A' + 10;
+    }
+    if (c >= 'a' && c <= 'z') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+// Append the reference being read to the array being read
+static inline void json_stream_push(struct json_stream *js) {
+    if (js->num_values == js->values_size) {
+        size_t new_size = js->values_size ? js->values_size * 2 : 1024;
+        uint32_t *new_values = (uint32_t *) realloc(js->values, new_size * sizeof(uint32_t));
+        if (new_values == NULL) {
+            js->error = JSON_ERROR_ALLOC;
+            return;
+        }
+        js->values = new_values;
+        js->values_size = new_size;
+    }
+    js->values[js->num_values++] = js->value;
+    js->value = 0;
+    js->in_value = 0;
+}
 
+// Add the finished array under its key to the hash table
+static inline void json_stream_emit(struct json_stream *js, struct hashtable *ht) {
+    if (js->positions ? !valid_positions(js->values, js->num_values) : to_verse_ids(js->values, js->num_values)) {
+        js->error = JSON_ERROR_FORMAT;
+        return;
+    }
+    uint32_t length = (uint32_t) normalize_references(js->values, js->num_values),
+             offset;
+    int error = js->positions ? append_positions(ht, js->values, length, &offset)
+                              : append_postings(ht, js->values, length, &offset);
+    if (error || add_element(ht, js->key, offset, length) == NULL) {
+        js->error = JSON_ERROR_ALLOC;
+    }
 }
 
+/*
+ * Parse the next `length` bytes of JSON into the hash table.
+ * Tokens and arrays may be split across chunks at any point.
+ * Returns 0 on success, otherwise the parser's error.
+ */
+static inline int parse_json_chunk(struct json_stream *js, const char *chunk, size_t length, struct hashtable *ht) {
+    for (size_t i = 0; i < length && !js->error; i++) {
+        char c = chunk[i];
+        switch (js->state) {
+        case JSON_SEEK_KEY:
+            if (c == '\"') {
+                js->key_length = 0;
+                js->state = JSON_IN_KEY;
+            }
+            break;
+
+        case JSON_IN_KEY:
+            if (c == '\"') {
+                js->key[js->key_length] = '\0';
+                js->state = JSON_SEEK_ARRAY;
+            }
+            // Keys have to fit in an element
+            else if (js->key_length + 1 >= sizeof(((struct element *) 0)->key)) {
+                js->error = JSON_ERROR_FORMAT;
+            }
+            else {
+                js->key[js->key_length++] = c;
+            }
+            break;
+
+        case JSON_SEEK_ARRAY:
+            if (c == '[') {
+                js->num_values = 0;
+                js->value = 0;
+                js->in_value = 0;
+                js->state = JSON_IN_ARRAY;
+            }
+            break;
+
+        default: {
+            int digit = base36_digit(c);
+            if (digit >= 0) {
+                js->value = js->value * REF_NUM_BASE + (uint32_t) digit;
+                js->in_value = 1;
+            }
+            else if (c == ',') {
+                if (js->in_value) {
+                    json_stream_push(js);
+                }
+            }
+            else if (c == ']') {
+                if (js->in_value) {
+                    json_stream_push(js);
+                }
+                if (!js->error) {
+                    json_stream_emit(js, ht);
+                }
+                js->state = JSON_SEEK_KEY;
+            }
+            break;
+        }
+        }
+    }
+    return js->error;
+}
 
 #endif
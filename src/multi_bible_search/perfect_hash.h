@@ -0,0 +1,212 @@
+#ifndef PERFECT_HASH_H
+#define PERFECT_HASH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Minimal perfect hashing of a fixed set of 64-bit key hashes, in the style of PTHash.
+ *
+ * Keys are split into buckets of about PERFECT_HASH_BUCKET_SIZE by the upper half of their hash. Each bucket has a
+ * pilot, picked while building so that mixing it into the hashes of the bucket's keys sends each of them to a
+ * position no other key has. There are exactly as many positions as keys, so a lookup is one pilot read and one
+ * position read, and the caller verifies the one key found there.
+ *
+ * Buckets of one key are placed last, into whatever positions are left, and their pilot is the key itself, marked
+ * with PERFECT_HASH_DIRECT. That saves a lookup in them the position read, and the build the slow search for pilots
+ * in an almost full table, which is what keeps small buckets cheap to build.
+ */
+#define PERFECT_HASH_BUCKET_SIZE 2
+#define PERFECT_HASH_DIRECT 0x80000000u
+// Give up on a bucket after this many pilots
+#define PERFECT_HASH_MAX_PILOT (1u << 24)
+
+struct perfect_hash
+{
+    // Pilot of each bucket, or the index of its only key with PERFECT_HASH_DIRECT set
+    uint32_t* pilots;
+    uint32_t num_buckets;
+    // Index of the key at each position
+    uint32_t* order;
+    uint32_t size;
+};
+
+// Map `x` onto [0, n) without a division
+static inline uint32_t reduce_range(uint32_t x, uint32_t n) {
+    return (uint32_t) (((uint64_t) x * n) >> 32);
+}
+
+// Scramble all of the bits of a 64-bit value (the MurmurHash3 finalizer)
+static inline uint64_t mix_hash(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+static inline uint32_t perfect_hash_bucket(uint64_t key_hash, uint32_t num_buckets) {
+    return reduce_range((uint32_t) (key_hash >> 32), num_buckets);
+}
+
+static inline uint32_t perfect_hash_position(uint64_t key_hash, uint32_t pilot, uint32_t size) {
+    return reduce_range((uint32_t) mix_hash(key_hash ^ ((uint64_t) pilot * 0x9e3779b97f4a7c15ull)), size);
+}
+
+// Get the index of the only key that can have the given hash. The hash set must not be empty
+static inline uint32_t perfect_hash_lookup(const struct perfect_hash* ph, uint64_t key_hash) {
+    uint32_t pilot = ph->pilots[perfect_hash_bucket(key_hash, ph->num_buckets)];
+    if (pilot & PERFECT_HASH_DIRECT) {
+        return pilot & ~PERFECT_HASH_DIRECT;
+    }
+    return ph->order[perfect_hash_position(key_hash, pilot, ph->size)];
+}
+
+// Free a perfect hash made by `build_perfect_hash`
+static inline void free_perfect_hash(struct perfect_hash* ph) {
+    free(ph->pilots);
+    free(ph->order);
+    memset(ph, 0, sizeof(*ph));
+}
+
+/*
+ * Build a minimal perfect hash over `count` distinct hashes.
+ * Returns 0 on success, or -1 if memory runs out, two of the hashes are the same, or there are too many.
+ */
+static inline int build_perfect_hash(struct perfect_hash* ph, const uint64_t* hashes, uint32_t count) {
+    memset(ph, 0, sizeof(*ph));
+    if (count == 0 || count >= PERFECT_HASH_DIRECT) {
+        return -1;
+    }
+    uint32_t num_buckets = count / PERFECT_HASH_BUCKET_SIZE + 1;
+    uint32_t* pilots = (uint32_t*) calloc(num_buckets, sizeof(uint32_t));
+    uint32_t* order = (uint32_t*) malloc(count * sizeof(uint32_t));
+    // Start of each bucket's keys in `keys`, and then the buckets sorted by size
+    uint32_t* bucket_start = (uint32_t*) calloc(num_buckets + 1, sizeof(uint32_t));
+    uint32_t* keys = (uint32_t*) malloc(count * sizeof(uint32_t));
+    uint32_t* buckets = (uint32_t*) malloc(num_buckets * sizeof(uint32_t));
+    uint64_t* taken = (uint64_t*) calloc((count + 63) / 64, sizeof(uint64_t));
+    uint32_t* sizes = NULL;
+    uint32_t* positions = NULL;
+    int error = -1;
+    if (pilots == NULL || order == NULL || bucket_start == NULL || keys == NULL || buckets == NULL || taken == NULL) {
+        goto cleanup;
+    }
+
+    // Group the keys by bucket with a counting sort
+    for (uint32_t i = 0; i < count; i++) {
+        bucket_start[perfect_hash_bucket(hashes[i], num_buckets) + 1]++;
+    }
+    uint32_t max_size = 0;
+    for (uint32_t b = 0; b < num_buckets; b++) {
+        if (bucket_start[b + 1] > max_size) {
+            max_size = bucket_start[b + 1];
+        }
+        bucket_start[b + 1] += bucket_start[b];
+    }
+    // Use `buckets` as the fill count of each bucket for now
+    memset(buckets, 0, num_buckets * sizeof(uint32_t));
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t b = perfect_hash_bucket(hashes[i], num_buckets);
+        keys[bucket_start[b] + buckets[b]++] = i;
+    }
+
+    // Place the largest buckets first, while there are plenty of free positions
+    sizes = (uint32_t*) calloc(max_size + 2, sizeof(uint32_t));
+    positions = (uint32_t*) malloc(max_size * sizeof(uint32_t));
+    if (sizes == NULL || positions == NULL) {
+        goto cleanup;
+    }
+    for (uint32_t b = 0; b < num_buckets; b++) {
+        sizes[max_size - (bucket_start[b + 1] - bucket_start[b]) + 1]++;
+    }
+    for (uint32_t s = 0; s <= max_size; s++) {
+        sizes[s + 1] += sizes[s];
+    }
+    for (uint32_t b = 0; b < num_buckets; b++) {
+        buckets[sizes[max_size - (bucket_start[b + 1] - bucket_start[b])]++] = b;
+    }
+
+    // Next position that may be free, for the buckets of one key
+    uint32_t next_free = 0;
+    for (uint32_t i = 0; i < num_buckets; i++) {
+        uint32_t b = buckets[i];
+        const uint32_t* bucket_keys = &keys[bucket_start[b]];
+        uint32_t size = bucket_start[b + 1] - bucket_start[b];
+        // The rest are empty
+        if (size == 0) {
+            break;
+        }
+        // No pilot can separate two equal hashes
+        for (uint32_t j = 0; j < size; j++) {
+            for (uint32_t k = 0; k < j; k++) {
+                if (hashes[bucket_keys[j]] == hashes[bucket_keys[k]]) {
+                    goto cleanup;
+                }
+            }
+        }
+        if (size == 1) {
+            while (taken[next_free / 64] & (1ull << (next_free % 64))) {
+                next_free++;
+            }
+            pilots[b] = PERFECT_HASH_DIRECT | bucket_keys[0];
+            taken[next_free / 64] |= 1ull << (next_free % 64);
+            order[next_free] = bucket_keys[0];
+            continue;
+        }
+
+        uint32_t pilot = 0;
+        for (; pilot < PERFECT_HASH_MAX_PILOT; pilot++) {
+            uint32_t placed = 0;
+            for (; placed < size; placed++) {
+                uint32_t position = perfect_hash_position(hashes[bucket_keys[placed]], pilot, count);
+                if (taken[position / 64] & (1ull << (position % 64))) {
+                    break;
+                }
+                // Keys of the same bucket can't share a position either
+                uint32_t k = 0;
+                while (k < placed && positions[k] != position) {
+                    k++;
+                }
+                if (k < placed) {
+                    break;
+                }
+                positions[placed] = position;
+            }
+            if (placed == size) {
+                break;
+            }
+        }
+        if (pilot == PERFECT_HASH_MAX_PILOT) {
+            goto cleanup;
+        }
+        pilots[b] = pilot;
+        for (uint32_t j = 0; j < size; j++) {
+            taken[positions[j] / 64] |= 1ull << (positions[j] % 64);
+            order[positions[j]] = bucket_keys[j];
+        }
+    }
+
+    ph->pilots = pilots;
+    ph->num_buckets = num_buckets;
+    ph->order = order;
+    ph->size = count;
+    pilots = NULL;
+    order = NULL;
+    error = 0;
+
+cleanup:
+    free(pilots);
+    free(order);
+    free(bucket_start);
+    free(keys);
+    free(buckets);
+    free(taken);
+    free(sizes);
+    free(positions);
+    return error;
+}
+
+#endif
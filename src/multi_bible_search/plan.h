@@ -0,0 +1,52 @@
+#ifndef PLAN_H
+#define PLAN_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "tokenize.h"
+#include "arena.h"
+
+/*
+ * Query planning, between tokenizing a query and counting it: each distinct token is kept once with how many times it
+ * was in the query (its weight), so that its lists are only counted once.
+ */
+
+/*
+ * Keep the first of every token that repeats, in query order, with how many times it's in the query in `weights`.
+ * Returns the number of distinct tokens, or -1 if memory (from the arena) runs out.
+ */
+static inline int dedupe_tokens(struct query_token* tokens, int num_tokens, int* weights, struct arena* arena) {
+    // Open addressing on the tokens' hashes, at most half full, holding the index of a distinct token plus one
+    size_t size = 8;
+    while (size < (size_t) num_tokens * 2) {
+        size *= 2;
+    }
+    uint32_t* slots = (uint32_t*) arena_calloc(arena, size, sizeof(uint32_t));
+    if (slots == NULL) {
+        return -1;
+    }
+    int distinct = 0;
+    for (int i = 0; i < num_tokens; i++) {
+        const struct query_token token = tokens[i];
+        size_t j = (size_t) token.hash & (size - 1);
+        for (; slots[j]; j = (j + 1) & (size - 1)) {
+            const struct query_token* seen = &tokens[slots[j] - 1];
+            if (seen->hash == token.hash && seen->length == token.length && seen->prefix == token.prefix &&
+                !memcmp(seen->text, token.text, token.length)) {
+                break;
+            }
+        }
+        if (slots[j]) {
+            weights[slots[j] - 1]++;
+            continue;
+        }
+        tokens[distinct] = token;
+        weights[distinct] = 1;
+        slots[j] = (uint32_t) ++distinct;
+    }
+    return distinct;
+}
+
+#endif
@@ -0,0 +1,168 @@
+#ifndef POSITIONS_H
+#define POSITIONS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "hashtable.h"
+#include "dictionary.h"
+#include "verses.h"
+
+/*
+ * Positional index of a version, for phrase searches: for each term, where in which verses it is, as sorted
+ * `verse ID * POSITION_LIMIT + position` values, a position being the index of the token among the indexed tokens of
+ * its verse. It's loaded and installed like any other table, into a term_table whose postings hold plain uint32
+ * arrays rather than encoded lists, since its values are well past the verse IDs postings.h encodes.
+ */
+
+// Positions a verse has room for. Longer verses (there are none) lose their tail
+#define POSITION_LIMIT 1024
+
+// Verse of a positional value
+static inline uint32_t position_verse(uint32_t value) {
+    return value / POSITION_LIMIT;
+}
+
+// Position within its verse of a positional value
+static inline uint32_t position_offset(uint32_t value) {
+    return value % POSITION_LIMIT;
+}
+
+/*
+ * Copy a sorted list of positional values onto the end of the table's postings.
+ * Returns 0 on success and stores the list's (byte) offset, or -1 if memory runs out.
+ */
+static inline int append_positions(struct hashtable* ht, const uint32_t* values, uint32_t count, uint32_t* offset) {
+    size_t needed = ht->postings_size + count * sizeof(uint32_t);
+    if (needed > ht->postings_capacity) {
+        size_t new_capacity = ht->postings_capacity ? ht->postings_capacity * 2 : 64 * 1024;
+        while (new_capacity < needed) {
+            new_capacity *= 2;
+        }
+        uint8_t* new_postings = (uint8_t*) realloc(ht->postings, new_capacity);
+        if (new_postings == NULL) {
+            return -1;
+        }
+        ht->postings = new_postings;
+        ht->postings_capacity = new_capacity;
+    }
+    *offset = (uint32_t) ht->postings_size;
+    memcpy(ht->postings + ht->postings_size, values, count * sizeof(uint32_t));
+    ht->postings_size = needed;
+    return 0;
+}
+
+// Whether every value of a positional list is a position in a verse
+static inline int valid_positions(const uint32_t* values, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        if (values[i] >= NUM_VERSES * POSITION_LIMIT) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Get the values of a positional list of a table
+static inline const uint32_t* get_list_positions(const struct term_table* table, const struct posting_list* list) {
+    return (const uint32_t*) (table->postings + list->offset);
+}
+
+/*
+ * Find the first value of a sorted list, from `from` on, that's at least `target`, or `length` if there's none.
+ * The step doubles until it passes the target and is then halved back, so that moving a cursor through a list for
+ * increasing targets costs the log of how far it moves rather than of the list.
+ */
+static inline size_t gallop_to(const uint32_t* list, size_t length, size_t from, uint32_t target) {
+    if (from >= length || list[from] >= target) {
+        return from;
+    }
+    // list[low] < target all along
+    size_t low = from,
+           step = 1;
+    while (low + step < length && list[low + step] < target) {
+        low += step;
+        step *= 2;
+    }
+    size_t high = low + step < length ? low + step : length;
+    while (high - low > 1) {
+        size_t middle = low + (high - low) / 2;
+        if (list[middle] < target) {
+            low = middle;
+        }
+        else {
+            high = middle;
+        }
+    }
+    return high;
+}
+
+// A word of a phrase: its positional list, and how far into the phrase it is
+struct phrase_word
+{
+    const uint32_t* positions;
+    size_t length;
+    uint32_t offset;
+    // Where the last lookup in the list left off
+    size_t cursor;
+};
+
+static int compare_phrase_words(const void* a, const void* b) {
+    size_t x = ((const struct phrase_word*) a)->length,
+           y = ((const struct phrase_word*) b)->length;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Find the verses with every word of a phrase next to each other, in order, into `results` (room for the rarest
+ * word's list), in verse ID order and up to `max_results` of them.
+ * Every place the rarest word is at gives where the phrase would start, which each other word, rarest first, is then
+ * looked up at by galloping through its list, so that a place is dropped after as few lookups as possible. Verse text
+ * is never needed. The words are reordered. Returns the number of verses.
+ */
+static inline size_t phrase_postings(struct phrase_word* words, int num_words, size_t max_results, uint32_t* results) {
+    if (num_words == 0 || max_results == 0) {
+        return 0;
+    }
+    qsort(words, num_words, sizeof(struct phrase_word), compare_phrase_words);
+    uint32_t phrase_length = 0;
+    for (int i = 0; i < num_words; i++) {
+        words[i].cursor = 0;
+        if (words[i].offset + 1 > phrase_length) {
+            phrase_length = words[i].offset + 1;
+        }
+    }
+
+    const struct phrase_word rarest = words[0];
+    size_t count = 0;
+    for (size_t i = 0; i < rarest.length; i++) {
+        uint32_t value = rarest.positions[i];
+        // The whole phrase has to fit in the verse
+        if (position_offset(value) < rarest.offset ||
+            position_offset(value) - rarest.offset + phrase_length > POSITION_LIMIT) {
+            continue;
+        }
+        uint32_t start = value - rarest.offset,
+                 verse = position_verse(start);
+        // Already found in this verse
+        if (count && results[count - 1] == verse) {
+            continue;
+        }
+        int found = 1;
+        for (int j = 1; j < num_words && found; j++) {
+            struct phrase_word* word = &words[j];
+            // Starts only increase, so the cursors only move forward
+            word->cursor = gallop_to(word->positions, word->length, word->cursor, start + word->offset);
+            found = word->cursor < word->length && word->positions[word->cursor] == start + word->offset;
+        }
+        if (found) {
+            results[count++] = verse;
+            if (count == max_results) {
+                break;
+            }
+        }
+    }
+    return count;
+}
+
+#endif
@@ -0,0 +1,533 @@
+#ifndef POSTINGS_H
+#define POSTINGS_H
+
+#include <stdint.h>
+#include <string.h>
+#include "cpu_features.h"
+#include "verses.h"
+
+/*
+ * Compressed posting lists.
+ *
+ * A list of sorted references is split into blocks of POSTING_BLOCK_SIZE. Each reference is stored as the difference
+ * from the one before it (the first one from 0) using Stream VByte: every group of four deltas has one control byte
+ * with 2 bits per delta holding its length in bytes (1 to 4), and the deltas follow as little-endian bytes.
+ * A block is its control bytes followed by its data bytes, and the blocks of a list are stored back to back.
+ * Lists of more than one block start with a skip table: the last reference of each block as 16 bits (verse IDs always
+ * fit), so that readers can pass over blocks without decoding them.
+ *
+ * Decoding a group of four is one shuffle and a prefix sum with SSSE3 (picked at runtime when the CPU has it), and
+ * decoders may read up to POSTING_PADDING bytes past the end of a list, so storage for lists must have that much
+ * slack at the end.
+ *
+ * Lists of common words cover so many verses that a bitmap of every verse is smaller, so lists of POSTING_BITMAP_MIN
+ * references or more (where the deltas would take at least as much, at 1.25 bytes a reference) are stored as one
+ * instead: POSTING_BITMAP_WORDS 64-bit words in host order, with bit v % 64 of word v / 64 set if the list has verse
+ * ID v. Which one a list is follows from its length.
+ */
+#define POSTING_BLOCK_SIZE 128
+#define POSTING_PADDING 16
+#define POSTING_BITMAP_WORDS ((NUM_VERSES + 63) / 64)
+#define POSTING_BITMAP_SIZE (POSTING_BITMAP_WORDS * sizeof(uint64_t))
+#define POSTING_BITMAP_MIN (POSTING_BITMAP_SIZE * 4 / 5)
+
+// Number of data bytes of each group of four deltas, by control byte
+static uint8_t posting_group_length[256];
+#ifdef CPU_X86_SIMD
+// Shuffle that spreads the data bytes of a group of four deltas into four 32-bit lanes, by control byte
+static uint8_t posting_group_shuffle[256][16];
+#endif
+
+// Whether a list of `count` references is stored as a bitmap
+static inline int is_bitmap_postings(uint32_t count) {
+    return count >= POSTING_BITMAP_MIN;
+}
+
+// Word `i` of a bitmap, which may not be aligned
+static inline uint64_t bitmap_word(const uint8_t* bitmap, uint32_t i) {
+    uint64_t word;
+    memcpy(&word, bitmap + i * sizeof(uint64_t), sizeof(uint64_t));
+    return word;
+}
+
+// Index of the lowest set bit of a nonzero word
+static inline uint32_t lowest_bit(uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+    return (uint32_t) __builtin_ctzll(word);
+#else
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return (uint32_t) index;
+#endif
+}
+
+// Size in bytes of the skip table in front of the blocks of a list of `count` references
+static inline size_t posting_skips_size(uint32_t count) {
+    uint32_t blocks = (count + POSTING_BLOCK_SIZE - 1) / POSTING_BLOCK_SIZE;
+    return blocks > 1 ? blocks * sizeof(uint16_t) : 0;
+}
+
+// Entry `block` of a skip table, which may not be aligned
+static inline uint32_t posting_skip(const uint8_t* skips, uint32_t block) {
+    uint16_t last;
+    memcpy(&last, skips + block * sizeof(uint16_t), sizeof(uint16_t));
+    return last;
+}
+
+// Upper bound of the encoded size of a list of `count` references
+static inline size_t max_encoded_postings(uint32_t count) {
+    if (is_bitmap_postings(count)) {
+        return POSTING_BITMAP_SIZE;
+    }
+    return posting_skips_size(count) + (size_t) count * sizeof(uint32_t) + (count + 3) / 4;
+}
+
+// Encode `count` sorted verse IDs into `out`, returning the number of bytes written
+static inline size_t encode_postings(const uint32_t* values, uint32_t count, uint8_t* out) {
+    if (is_bitmap_postings(count)) {
+        uint64_t words[POSTING_BITMAP_WORDS] = {0};
+        for (uint32_t i = 0; i < count; i++) {
+            words[values[i] / 64] |= (uint64_t) 1 << (values[i] % 64);
+        }
+        memcpy(out, words, POSTING_BITMAP_SIZE);
+        return POSTING_BITMAP_SIZE;
+    }
+    uint8_t* start = out;
+    uint32_t previous = 0;
+    if (posting_skips_size(count)) {
+        for (uint32_t block = 0; block < count; block += POSTING_BLOCK_SIZE) {
+            uint32_t last = block + POSTING_BLOCK_SIZE < count ? block + POSTING_BLOCK_SIZE - 1 : count - 1;
+            uint16_t skip = (uint16_t) values[last];
+            memcpy(out, &skip, sizeof(uint16_t));
+            out += sizeof(uint16_t);
+        }
+    }
+    for (uint32_t block = 0; block < count; block += POSTING_BLOCK_SIZE) {
+        uint32_t block_count = count - block < POSTING_BLOCK_SIZE ? count - block : POSTING_BLOCK_SIZE;
+        uint8_t* control = out;
+        uint8_t* data = out + (block_count + 3) / 4;
+        memset(control, 0, (block_count + 3) / 4);
+        for (uint32_t i = 0; i < block_count; i++) {
+            uint32_t delta = values[block + i] - previous;
+            previous = values[block + i];
+            uint8_t length = delta < (1u << 8) ? 1 : delta < (1u << 16) ? 2 : delta < (1u << 24) ? 3 : 4;
+            control[i / 4] |= (uint8_t) ((length - 1) << (2 * (i % 4)));
+            for (uint8_t byte = 0; byte < length; byte++) {
+                *data++ = (uint8_t) (delta >> (8 * byte));
+            }
+        }
+        out = data;
+    }
+    return (size_t) (out - start);
+}
+
+// Size in bytes of an encoded block of `block_count` references, from its control bytes
+static inline size_t posting_block_size(const uint8_t* control, uint32_t block_count) {
+    size_t length = (block_count + 3) / 4;
+    for (uint32_t group = 0; group < block_count / 4; group++) {
+        length += posting_group_length[control[group]];
+    }
+    // A partial group only counts its used lanes
+    for (uint32_t i = block_count & ~3u; i < block_count; i++) {
+        length += ((control[i / 4] >> (2 * (i % 4))) & 3) + 1;
+    }
+    return length;
+}
+
+// Size in bytes of an encoded list of `count` references
+static inline size_t encoded_postings_size(const uint8_t* data, uint32_t count) {
+    if (is_bitmap_postings(count)) {
+        return POSTING_BITMAP_SIZE;
+    }
+    const uint8_t* start = data;
+    data += posting_skips_size(count);
+    for (uint32_t block = 0; block < count; block += POSTING_BLOCK_SIZE) {
+        uint32_t block_count = count - block < POSTING_BLOCK_SIZE ? count - block : POSTING_BLOCK_SIZE;
+        data += posting_block_size(data, block_count);
+    }
+    return (size_t) (data - start);
+}
+
+// Decode references `i` onwards of a block one at a time, from the data of reference `i`
+static inline const uint8_t* decode_posting_tail(const uint8_t* control, const uint8_t* data, uint32_t i, uint32_t block_count,
+                                                 uint32_t* previous, uint32_t* out) {
+    uint32_t value = *previous;
+    for (; i < block_count; i++) {
+        int length = ((control[i / 4] >> (2 * (i % 4))) & 3) + 1;
+        uint32_t delta = 0;
+        for (int byte = 0; byte < length; byte++) {
+            delta |= (uint32_t) data[byte] << (8 * byte);
+        }
+        data += length;
+        value += delta;
+        out[i] = value;
+    }
+    *previous = value;
+    return data;
+}
+
+/*
+ * Decode one block of `block_count` references, continuing on from `*previous`.
+ * Returns a pointer just past the block.
+ */
+static const uint8_t* decode_posting_block_scalar(const uint8_t* in, uint32_t block_count, uint32_t* previous, uint32_t* out) {
+    return decode_posting_tail(in, in + (block_count + 3) / 4, 0, block_count, previous, out);
+}
+
+#ifdef CPU_X86_SIMD
+TARGET_SSSE3 static const uint8_t* decode_posting_block_ssse3(const uint8_t* in, uint32_t block_count, uint32_t* previous, uint32_t* out) {
+    const uint8_t* control = in;
+    const uint8_t* data = in + (block_count + 3) / 4;
+    uint32_t i = 0;
+    __m128i last = _mm_set1_epi32((int) *previous);
+    for (; i + 4 <= block_count; i += 4) {
+        uint8_t c = control[i / 4];
+        __m128i deltas = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) data),
+                                          _mm_loadu_si128((const __m128i*) posting_group_shuffle[c]));
+        // Prefix sum of the four deltas, carried on from the last reference
+        deltas = _mm_add_epi32(deltas, _mm_slli_si128(deltas, 4));
+        deltas = _mm_add_epi32(deltas, _mm_slli_si128(deltas, 8));
+        last = _mm_add_epi32(deltas, last);
+        _mm_storeu_si128((__m128i*) &out[i], last);
+        last = _mm_shuffle_epi32(last, 0xFF);
+        data += posting_group_length[c];
+    }
+    *previous = (uint32_t) _mm_cvtsi128_si32(last);
+    // Whatever doesn't fill a group of four
+    return decode_posting_tail(control, data, i, block_count, previous, out);
+}
+#endif
+
+// Block decoder for this CPU, picked by `init_posting_tables`
+static const uint8_t* (*decode_posting_block)(const uint8_t* in, uint32_t block_count, uint32_t* previous, uint32_t* out) =
+    decode_posting_block_scalar;
+
+/*
+ * Position of the first of the `count` values of a decoded block, from `position` on, that's at least `target`, which
+ * the last one is.
+ */
+static uint32_t find_in_block_scalar(const uint32_t* values, uint32_t position, uint32_t count, uint32_t target) {
+    (void) count;
+    while (values[position] < target) {
+        position++;
+    }
+    return position;
+}
+
+#ifdef CPU_X86_SIMD
+// Compares four values at a time, as signed numbers, which verse IDs always fit
+TARGET_SSE2 static uint32_t find_in_block_sse2(const uint32_t* values, uint32_t position, uint32_t count, uint32_t target) {
+    const __m128i bound = _mm_set1_epi32((int) target);
+    for (; position + 4 <= count; position += 4) {
+        __m128i less = _mm_cmplt_epi32(_mm_loadu_si128((const __m128i*) &values[position]), bound);
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(less));
+        if (mask != 0xF) {
+            return position + lowest_bit((uint64_t) (~mask & 0xF));
+        }
+    }
+    return find_in_block_scalar(values, position, count, target);
+}
+#endif
+
+// In-block search for this CPU, picked by `init_posting_tables`
+static uint32_t (*find_in_block)(const uint32_t* values, uint32_t position, uint32_t count, uint32_t target) =
+    find_in_block_scalar;
+
+// Fill in the decoding tables and pick the decoder. Call once before decoding anything
+static inline void init_posting_tables(void) {
+    for (int control = 0; control < 256; control++) {
+        int offset = 0;
+        for (int lane = 0; lane < 4; lane++) {
+            int length = ((control >> (2 * lane)) & 3) + 1;
+#ifdef CPU_X86_SIMD
+            for (int byte = 0; byte < 4; byte++) {
+                // 0x80 zeroes the byte
+                posting_group_shuffle[control][lane * 4 + byte] = (uint8_t) (byte < length ? offset + byte : 0x80);
+            }
+#endif
+            offset += length;
+        }
+        posting_group_length[control] = (uint8_t) offset;
+    }
+    decode_posting_block = decode_posting_block_scalar;
+    find_in_block = find_in_block_scalar;
+#ifdef CPU_X86_SIMD
+    if (cpu_features() & CPU_SSSE3) {
+        decode_posting_block = decode_posting_block_ssse3;
+    }
+    if (cpu_features() & CPU_SSE2) {
+        find_in_block = find_in_block_sse2;
+    }
+#endif
+}
+
+/*
+ * Decode up to `count` verse IDs of a bitmap into `out`, from word `*word` on, of which `*bits` are the ones left.
+ * Returns how many were decoded, which is only fewer at the end of the bitmap.
+ */
+static inline uint32_t decode_bitmap(const uint8_t* bitmap, uint32_t count, uint32_t* word, uint64_t* bits, uint32_t* out) {
+    uint32_t n = 0;
+    while (n < count) {
+        while (*bits == 0) {
+            if (++*word >= POSTING_BITMAP_WORDS) {
+                return n;
+            }
+            *bits = bitmap_word(bitmap, *word);
+        }
+        out[n++] = *word * 64 + lowest_bit(*bits);
+        *bits &= *bits - 1;
+    }
+    return n;
+}
+
+// Sequential reader of an encoded posting list, a block at a time
+struct posting_cursor
+{
+    const uint8_t* data;
+    // References not yet decoded
+    uint32_t remaining;
+    uint32_t previous;
+    // Position in a bitmap, the word and its bits not yet decoded
+    uint32_t word;
+    uint64_t bits;
+    int is_bitmap;
+    // The current block
+    uint32_t values[POSTING_BLOCK_SIZE];
+    uint32_t count;
+};
+
+static inline void cursor_init(struct posting_cursor* cursor, const uint8_t* data, uint32_t length) {
+    cursor->data = is_bitmap_postings(length) ? data : data + posting_skips_size(length);
+    cursor->remaining = length;
+    cursor->previous = 0;
+    cursor->is_bitmap = is_bitmap_postings(length);
+    cursor->word = 0;
+    cursor->bits = cursor->is_bitmap ? bitmap_word(data, 0) : 0;
+    cursor->count = 0;
+}
+
+// Decode the next block into `cursor->values`, returning how many references it holds (0 at the end)
+static inline uint32_t cursor_next_block(struct posting_cursor* cursor) {
+    uint32_t count = cursor->remaining < POSTING_BLOCK_SIZE ? cursor->remaining : POSTING_BLOCK_SIZE;
+    if (count) {
+        if (cursor->is_bitmap) {
+            decode_bitmap(cursor->data, count, &cursor->word, &cursor->bits, cursor->values);
+        }
+        else {
+            cursor->data = decode_posting_block(cursor->data, count, &cursor->previous, cursor->values);
+        }
+        cursor->remaining -= count;
+    }
+    cursor->count = count;
+    return count;
+}
+
+// Decode a whole list of `length` references into `out`
+static inline void decode_postings(const uint8_t* data, uint32_t length, uint32_t* out) {
+    if (is_bitmap_postings(length)) {
+        for (uint32_t word = 0; word < POSTING_BITMAP_WORDS; word++) {
+            uint32_t base = word * 64;
+            for (uint64_t bits = bitmap_word(data, word); bits; bits &= bits - 1) {
+                *out++ = base + lowest_bit(bits);
+            }
+        }
+        return;
+    }
+    uint32_t previous = 0;
+    data += posting_skips_size(length);
+    for (uint32_t block = 0; block < length; block += POSTING_BLOCK_SIZE) {
+        uint32_t count = length - block < POSTING_BLOCK_SIZE ? length - block : POSTING_BLOCK_SIZE;
+        data = decode_posting_block(data, count, &previous, &out[block]);
+    }
+}
+
+/*
+ * Whether an encoded list of `length` references, with `available` bytes of storage (and the padding past them),
+ * fits in it and decodes to strictly increasing verse IDs that match its skip table, so that it's safe to search.
+ * For lists that come from outside, like mapped index files.
+ */
+static inline int valid_postings(const uint8_t* data, uint32_t length, size_t available) {
+    if (length > NUM_VERSES) {
+        return 0;
+    }
+    if (is_bitmap_postings(length)) {
+        if (available < POSTING_BITMAP_SIZE) {
+            return 0;
+        }
+        uint32_t count = 0;
+        for (uint32_t word = 0; word < POSTING_BITMAP_WORDS; word++) {
+            for (uint64_t bits = bitmap_word(data, word); bits; bits &= bits - 1) {
+                if (word * 64 + lowest_bit(bits) >= NUM_VERSES) {
+                    return 0;
+                }
+                count++;
+            }
+        }
+        return count == length;
+    }
+
+    size_t skips_size = posting_skips_size(length);
+    if (available < skips_size) {
+        return 0;
+    }
+    const uint8_t* skips = data;
+    const uint8_t* end = data + available;
+    data += skips_size;
+    uint32_t values[POSTING_BLOCK_SIZE],
+             previous = 0;
+    for (uint32_t block = 0; block < length; block += POSTING_BLOCK_SIZE) {
+        uint32_t count = length - block < POSTING_BLOCK_SIZE ? length - block : POSTING_BLOCK_SIZE;
+        // The control bytes have to be there to size the block by
+        if ((size_t) (end - data) < (count + 3) / 4 || (size_t) (end - data) < posting_block_size(data, count)) {
+            return 0;
+        }
+        uint32_t last = previous;
+        data = decode_posting_block(data, count, &previous, values);
+        for (uint32_t i = 0; i < count; i++) {
+            // Deltas that wrap around show up as decreasing
+            if (values[i] >= NUM_VERSES || ((block || i) && values[i] <= last)) {
+                return 0;
+            }
+            last = values[i];
+        }
+        if (skips_size && posting_skip(skips, block / POSTING_BLOCK_SIZE) != last) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Reader of an encoded posting list a reference at a time, which can skip ahead past blocks (by the skip table) or
+ * bitmap words without decoding them.
+ */
+struct posting_iterator
+{
+    // The bitmap, or the skip table and the next block to decode
+    const uint8_t* postings;
+    const uint8_t* data;
+    uint32_t length;
+    int is_bitmap;
+    uint32_t block;
+    // The decoded block and the position of the current reference in it
+    uint32_t values[POSTING_BLOCK_SIZE];
+    uint32_t count;
+    uint32_t position;
+    // The current reference, NO_VERSE once the list runs out
+    uint32_t verse;
+};
+
+/*
+ * The first block of a skip table, from `block` on, whose last reference is at least `target`, or `num_blocks` if
+ * there's none. The step doubles until it passes the target and is then halved back, so that seeking costs the log of
+ * how many blocks it passes over rather than their number.
+ */
+static inline uint32_t find_skip(const uint8_t* skips, uint32_t block, uint32_t num_blocks, uint32_t target) {
+    if (block >= num_blocks || posting_skip(skips, block) >= target) {
+        return block;
+    }
+    // The last reference of block `low` is below the target all along
+    uint32_t low = block,
+             step = 1;
+    while (low + step < num_blocks && posting_skip(skips, low + step) < target) {
+        low += step;
+        step *= 2;
+    }
+    uint32_t high = low + step < num_blocks ? low + step : num_blocks;
+    while (high - low > 1) {
+        uint32_t middle = low + (high - low) / 2;
+        if (posting_skip(skips, middle) < target) {
+            low = middle;
+        }
+        else {
+            high = middle;
+        }
+    }
+    return high;
+}
+
+// Decode block `block` of an iterator's list, from `data`, as the current one
+static inline void iterator_load_block(struct posting_iterator* it, uint32_t block) {
+    uint32_t start = block * POSTING_BLOCK_SIZE,
+             previous = block ? posting_skip(it->postings, block - 1) : 0;
+    it->block = block;
+    it->count = it->length - start < POSTING_BLOCK_SIZE ? it->length - start : POSTING_BLOCK_SIZE;
+    it->data = decode_posting_block(it->data, it->count, &previous, it->values);
+    it->position = 0;
+    it->verse = it->values[0];
+}
+
+// The first set bit of a bitmap from verse ID `from` on, or NO_VERSE
+static inline uint32_t bitmap_next(const uint8_t* bitmap, uint32_t from) {
+    uint32_t word = from / 64;
+    if (word >= POSTING_BITMAP_WORDS) {
+        return NO_VERSE;
+    }
+    uint64_t bits = bitmap_word(bitmap, word) & (~(uint64_t) 0 << (from % 64));
+    while (bits == 0) {
+        if (++word >= POSTING_BITMAP_WORDS) {
+            return NO_VERSE;
+        }
+        bits = bitmap_word(bitmap, word);
+    }
+    return word * 64 + lowest_bit(bits);
+}
+
+// Start reading a nonempty list at its first reference
+static inline void iterator_init(struct posting_iterator* it, const uint8_t* data, uint32_t length) {
+    it->postings = data;
+    it->length = length;
+    it->is_bitmap = is_bitmap_postings(length);
+    if (it->is_bitmap) {
+        it->verse = bitmap_next(data, 0);
+        return;
+    }
+    it->data = data + posting_skips_size(length);
+    iterator_load_block(it, 0);
+}
+
+// Move on to the next reference
+static inline void iterator_next(struct posting_iterator* it) {
+    if (it->is_bitmap) {
+        it->verse = bitmap_next(it->postings, it->verse + 1);
+    }
+    else if (++it->position < it->count) {
+        it->verse = it->values[it->position];
+    }
+    else if ((it->block + 1) * POSTING_BLOCK_SIZE < it->length) {
+        iterator_load_block(it, it->block + 1);
+    }
+    else {
+        it->verse = NO_VERSE;
+    }
+}
+
+// Move on to the first reference at or after `target`, returning it (or NO_VERSE)
+static inline uint32_t iterator_seek(struct posting_iterator* it, uint32_t target) {
+    if (it->verse >= target) {
+        return it->verse;
+    }
+    if (it->is_bitmap) {
+        it->verse = bitmap_next(it->postings, target);
+        return it->verse;
+    }
+    if (it->values[it->count - 1] < target) {
+        // Only lists with more than one block get this far, so there's a skip table
+        uint32_t num_blocks = (it->length + POSTING_BLOCK_SIZE - 1) / POSTING_BLOCK_SIZE,
+                 block = find_skip(it->postings, it->block + 1, num_blocks, target);
+        if (block == num_blocks) {
+            it->verse = NO_VERSE;
+            return NO_VERSE;
+        }
+        // Every block passed over is a whole one
+        for (uint32_t skipped = it->block + 1; skipped < block; skipped++) {
+            it->data += posting_block_size(it->data, POSTING_BLOCK_SIZE);
+        }
+        iterator_load_block(it, block);
+    }
+    it->position = find_in_block(it->values, it->position, it->count, target);
+    it->verse = it->values[it->position];
+    return it->verse;
+}
+
+#endif
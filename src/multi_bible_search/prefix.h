@@ -0,0 +1,91 @@
+#ifndef PREFIX_H
+#define PREFIX_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "postings.h"
+#include "dictionary.h"
+#include "merge.h"
+#include "arena.h"
+
+/*
+ * Prefix tokens (`bless*`), which match every term starting with them. A verse counts once for such a token however
+ * many of its terms it has, and the searches expect the lists of a token to never share a verse, so the lists of the
+ * matching terms (found as a range of each table's sorted terms) are unioned into one list of the token first: set in
+ * a bitmap of every verse, and encoded back from it like any other list.
+ */
+
+// Set the verses of an encoded list in a bitmap of every verse
+static inline void union_list(const uint8_t* postings, uint32_t length, uint64_t* verses) {
+    if (is_bitmap_postings(length)) {
+        for (uint32_t word = 0; word < POSTING_BITMAP_WORDS; word++) {
+            verses[word] |= bitmap_word(postings, word);
+        }
+        return;
+    }
+    struct posting_cursor cursor;
+    cursor_init(&cursor, postings, length);
+    for (uint32_t count; (count = cursor_next_block(&cursor)) != 0;) {
+        for (uint32_t i = 0; i < count; i++) {
+            verses[cursor.values[i] / 64] |= (uint64_t) 1 << (cursor.values[i] % 64);
+        }
+    }
+}
+
+/*
+ * Find the lists of every term of the tables that starts with a prefix, as one source of token `token` counted
+ * `weight` times. A single list is used as it is, and more are unioned into a list in the arena.
+ * Returns 1 if there's a source, 0 if no term has the prefix, or -1 if memory (from the arena) runs out.
+ */
+static inline int prefix_source(const struct term_table* const* tables, int num_tables,
+                                const struct hashtable* dictionary, const char* prefix, uint32_t length, int weight,
+                                int token, struct merge_source* source, struct arena* arena) {
+    uint32_t first[3],
+             last[3],
+             matches = 0;
+    for (int t = 0; t < num_tables; t++) {
+        find_prefix_range(tables[t], dictionary, prefix, length, &first[t], &last[t]);
+        matches += last[t] - first[t];
+        if (last[t] > first[t]) {
+            const struct posting_list* list = get_posting_list(tables[t], tables[t]->sorted_terms[first[t]]);
+            *source = (struct merge_source) {get_list_postings(tables[t], list), list->length, weight, token};
+        }
+    }
+    if (matches <= 1) {
+        return (int) matches;
+    }
+
+    uint64_t* verses = (uint64_t*) arena_calloc(arena, POSTING_BITMAP_WORDS, sizeof(uint64_t));
+    if (verses == NULL) {
+        return -1;
+    }
+    for (int t = 0; t < num_tables; t++) {
+        for (uint32_t i = first[t]; i < last[t]; i++) {
+            const struct posting_list* list = get_posting_list(tables[t], tables[t]->sorted_terms[i]);
+            union_list(get_list_postings(tables[t], list), list->length, verses);
+        }
+    }
+    // Back to a sorted list, encoded
+    uint32_t* values = (uint32_t*) arena_alloc(arena, NUM_VERSES * sizeof(uint32_t));
+    if (values == NULL) {
+        return -1;
+    }
+    uint32_t count = 0;
+    for (uint32_t word = 0; word < POSTING_BITMAP_WORDS; word++) {
+        for (uint64_t bits = verses[word]; bits; bits &= bits - 1) {
+            values[count++] = word * 64 + lowest_bit(bits);
+        }
+    }
+    uint8_t* postings = (uint8_t*) arena_alloc(arena, max_encoded_postings(count) + POSTING_PADDING);
+    if (postings == NULL) {
+        return -1;
+    }
+    size_t size = encode_postings(values, count, postings);
+    memset(postings + size, 0, POSTING_PADDING);
+    *source = (struct merge_source) {postings, count, weight, token};
+    return 1;
+}
+
+#endif
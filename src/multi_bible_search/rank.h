@@ -6,371 +6,94 @@
 #include <string.h>
 #include <stdint.h>
 #include "memcpy_long.h"
+#include "merge.h"
+#include "arena.h"
 
-typedef struct result_pair {
-    uint32_t element;
-    uint_fast16_t count; 
-} result_pair;
-
-// Counting sort function for result_pair array
-static inline void countingSort(const result_pair * restrict arr, int n, uint32_t* destination, const uint_fast16_t max) {
-    // Stack-based for most cases, the path branch prediction should take
-    if (max <= 180) {
-        // On‐stack count array
-        int count[181] = {0};
-
-        // Store the count of each count value
-        for (int i = 0; i < n; i++) {
-            count[arr[i].count]++;
-        }
-
-        // Change count[i] so that count[i] contains the actual position of this count in the output array
-        for (int i = max - 1; i >= 0; i--) {
-            count[i] += count[i + 1];
-        }
-
-        // Build the output array
-        int tmp_count;
-        for (int i = n - 1; i >= 0; i--) {
-            tmp_count = arr[i].count;
-            destination[count[tmp_count] - 1] = arr[i].element;
-            count[tmp_count]--;
-        }
-    }
-    // Heap allocation for extreme edge cases
-    else {
-        // Create a count array to store count of each unique count value dynamically
-        int *count = (int *)calloc(max + 1, sizeof(int));
-
-        // Store the count of each count value
-        for (int i = 0; i < n; i++) {
-            count[arr[i].count]++;
-        }
-
-        // Change count[i] so that count[i] contains the actual position of this count in the output array
-        for (int i = max - 1; i >= 0; i--) {
-            count[i] += count[i + 1];
-        }
-
-        // Build the output array
-        int tmp_count;
-        for (int i = n - 1; i >= 0; i--) {
-            tmp_count = arr[i].count;
-            destination[count[tmp_count] - 1] = arr[i].element;
-            count[tmp_count]--;
-        }
-
-        // Clean up
-        free(count);
-    }
-}
+// Counts below this are bucketed on the stack, which covers all but the longest queries
+#define RANK_STACK_COUNTS 256
 
 /*
- * Merge two (individually sorted) lists together.
- * Assumes that the size of `dest` is `dest_len + src_len` 
+ * Rank elements in the result `array` (in reference order) by their frequency: those counted `target` times first,
+ * then the rest from the highest count down, each in reference order.
+ * Only the first `max_results` are written to `token_target`, returning how many that is, and their counts to
+ * `count_target` unless it's NULL. Counts too high to bucket on the stack are bucketed in the arena, and -1 is returned
+ * if that runs out.
  */
-static inline size_t merge_results(result_pair * restrict dest, size_t dest_len, const uint32_t * restrict src, size_t src_len) {
-    // Copy of the old destination array
-    result_pair *old = malloc(dest_len * sizeof(result_pair));
-    if (!old) {
-        printf("Memory allocation failure in merge_results\n");
+static inline Py_ssize_t rank(const result_pair * restrict array, size_t size, int target, Py_ssize_t max_results,
+                          uint32_t* token_target, uint32_t* count_target, struct arena* arena) {
+    if (size == 0 || target == 0 || max_results <= 0) {
         return 0;
     }
-    memcpy(old, dest, dest_len * sizeof(result_pair));
+    size_t quota = (size_t) max_results < size ? (size_t) max_results : size,
+           likely_count = 0;
+    // How many results have each count, then where the ones to keep go
+    size_t stack_buckets[RANK_STACK_COUNTS] = {0};
+    size_t* buckets = stack_buckets;
+    uint_fast16_t max = 0;
 
-    size_t i = 0, j = 0, k = 0;
-    
-    // Merge old (with counts) and src into dest
-    while (i < dest_len && j < src_len) {
-        uint32_t val_old = old[i].element;
-        uint32_t val_src = src[j];
-         
-        if (val_old == val_src) {
-            // Copy old entry, then add src occurrences
-            dest[k] = old[i];
-            // Count how many times src[j] repeats
-            uint_fast16_t extra = 0;
-            while (j < src_len && src[j] == val_src) {
-                extra++;
-                j++;
+    // The ones with the target count come first as they are, and fill the quota more often than not
+    for (size_t i = 0; i < size; i++) {
+        uint_fast16_t count = array[i].count;
+        if (count == (uint_fast16_t) target) {
+            if (count_target != NULL) {
+                count_target[likely_count] = (uint32_t) count;
+            }
+            token_target[likely_count++] = array[i].element;
+            if (likely_count == quota) {
+                return (Py_ssize_t) quota;
             }
-            dest[k].count += extra;
-            k++;
-            i++;
-        } 
-        else if (val_old < val_src) {
-            dest[k++] = old[i++];
         }
         else {
-            // New element from src
-            uint32_t current = val_src;
-            uint_fast16_t cnt = 0;
-            while (j < src_len && src[j] == current) {
-                cnt++;
-                j++;
+            if (count > max) {
+                max = count;
+            }
+            if (count < RANK_STACK_COUNTS) {
+                stack_buckets[count]++;
             }
-            dest[k].element = current;
-            dest[k].count = cnt;
-            k++;
-        }
-    }
-    
-    // Copy remaining old entries
-    while (i < dest_len) {
-        dest[k++] = old[i++];
-    }
-    
-    // Copy remaining src entries
-    while (j < src_len) {
-        uint32_t current = src[j];
-        uint_fast16_t cnt = 0;
-        while (j < src_len && src[j] == current) {
-            cnt++;
-            j++;
         }
-        dest[k].element = current;
-        dest[k].count = cnt;
-        k++;
-    }
-
-    free(old);
-    return k;
-}
-
-/*
- * Merge two (individually sorted) lists together.
- * Assumes that the size of `dest` is `dest_len + src_len` 
- */
-static inline size_t merge_results_count(result_pair * restrict dest, size_t dest_len, const uint32_t * restrict src, size_t src_len, int count) {
-    // Copy of the old destination array
-    result_pair *old = malloc(dest_len * sizeof(result_pair));
-    if (!old) {
-        printf("Memory allocation failure in merge_results\n");
-        return 0;
     }
-    memcpy(old, dest, dest_len * sizeof(result_pair));
-
-    size_t i = 0, j = 0, k = 0;
-    
-    // Merge old (with counts) and src into dest
-    while (i < dest_len && j < src_len) {
-        uint32_t val_old = old[i].element;
-        uint32_t val_src = src[j];
-         
-        if (val_old == val_src) {
-            // Copy old entry, then add src occurrences
-            dest[k] = old[i];
-            // Count how many times src[j] repeats
-            uint_fast16_t extra = 0;
-            while (j < src_len && src[j] == val_src) {
-                extra++;
-                j++;
-            }
-            dest[k].count += extra * count;
-            k++;
-            i++;
-        } 
-        else if (val_old < val_src) {
-            dest[k++] = old[i++];
+    // Heap allocation for extreme edge cases
+    if (max >= RANK_STACK_COUNTS) {
+        buckets = (size_t*) arena_calloc(arena, max + 1, sizeof(size_t));
+        if (buckets == NULL) {
+            // Attempt to fail gracefully
+            printf("Memory allocation error b!\n");
+            return -1;
         }
-        else {
-            // New element from src
-            uint32_t current = val_src;
-            uint_fast16_t cnt = 0;
-            while (j < src_len && src[j] == current) {
-                cnt++;
-                j++;
+        for (size_t i = 0; i < size; i++) {
+            if (array[i].count != (uint_fast16_t) target) {
+                buckets[array[i].count]++;
             }
-            dest[k].element = current;
-            dest[k].count = cnt * count;
-            k++;
         }
     }
-    
-    // Copy remaining old entries
-    while (i < dest_len) {
-        dest[k++] = old[i++];
-    }
-    
-    // Copy remaining src entries
-    while (j < src_len) {
-        uint32_t current = src[j];
-        uint_fast16_t cnt = 0;
-        while (j < src_len && src[j] == current) {
-            cnt++;
-            j++;
-        }
-        dest[k].element = current;
-        dest[k].count = cnt;
-        k++;
-    }
-
-    free(old);
-    return k;
-}
 
-// Rank elements in the result `array` by their frequency
-static inline size_t rank(const result_pair * restrict array, size_t size, int target, Py_ssize_t max_results, uint32_t* token_target) {
-    if (size == 0 || target == 0) {
-        return 0;
-    }
-    // Array of the other results
-    result_pair *others = (result_pair *) malloc(size * sizeof(result_pair));
-    // Max for counting sort
-    uint_fast16_t max = 0;
-    if (others == NULL) {
-        // Attempt to fail gracefully
-        printf("Memory allocation error b!\n");
-        return 0;
+    // From the highest count down, until the rest of the quota is filled, turn the counts into positions
+    size_t position = likely_count;
+    uint_fast16_t lowest = max;
+    for (;;) {
+        size_t n = buckets[lowest];
+        buckets[lowest] = position;
+        position += n;
+        if (position >= quota || lowest == 0) {
+            break;
+        }
+        lowest--;
     }
-    
-    int likely_count = 0,        // Size of the likely array
-        others_count = 0;        // Size of the others array
-    size_t max_index = size - 1; // The maximum index of the array
 
-    // Find duplicates of the desired count
-    for (uint_fast32_t i = 0; i < size; i++) {
-        // If it's what we're looking for, add it to the likely array
-        if (array[i].count == target) {
-            token_target[likely_count++] = array[i].element;
-        }
-        // Otherwise, put it in others
-        else {
-            others[others_count++] = array[i];
-            if (array[i].count > max) {
-                max = array[i].count;
+    // Only the first of the lowest count make it
+    size_t placed = likely_count;
+    for (size_t i = 0; i < size && placed < quota; i++) {
+        uint_fast16_t count = array[i].count;
+        if (count >= lowest && count != (uint_fast16_t) target && buckets[count] < quota) {
+            if (count_target != NULL) {
+                count_target[buckets[count]] = (uint32_t) count;
             }
+            token_target[buckets[count]++] = array[i].element;
+            placed++;
         }
     }
 
-    if (likely_count < max_results) {
-        // Sort the other results and add them to the correct place in the array
-        countingSort(others, others_count, &token_target[likely_count], max);
-
-        // Free dynamically allocated memory
-        free(others);
-        return (likely_count + others_count);
-    }
-
-    // Free dynamically allocated memory
-    free(others);
-    return max_results;
-}
-
-// Convert a string to lowercase
-static inline void make_lower(char *string) {
-    for ( ; *string; ++string) {
-        // Verbose, but this is fast
-        switch (*string)
-        {
-        case 'A':
-            *string = 'a';
-            break;
-
-        case 'B':
-            *string = 'b';
-            break;
-
-        case 'C':
-            *string = 'c';
-            break;
-
-        case 'D':
-            *string = 'd';
-            break;
-        
-        case 'E':
-            *string = 'e';
-            break;
-
-        case 'F':
-            *string = 'f';
-            break;
-
-        case 'G':
-            *string = 'g';
-            break;
-
-        case 'H':
-            *string = 'h';
-            break;
-
-        case 'I':
-            *string = 'i';
-            break;
-
-        case 'J':
-            *string = 'j';
-            break;
-
-        case 'K':
-            *string = 'k';
-            break;
-
-        case 'L':
-            *string = 'l';
-            break;
-
-        case 'M':
-            *string = 'm';
-            break;
-
-        case 'N':
-            *string = 'n';
-            break;
-
-        case 'O':
-            *string = 'o';
-            break;
-
-        case 'P':
-            *string = 'p';
-            break;
-
-        case 'Q':
-            *string = 'q';
-            break;
-
-        case 'R':
-            *string = 'r';
-            break;
-
-        case 'S':
-            *string = 's';
-            break;
-
-        case 'T':
-            *string = 't';
-            break;
-
-        case 'U':
-            *string = 'u';
-            break;
-
-        case 'V':
-            *string = 'v';
-            break;
-
-        case 'W':
-            *string = 'w';
-            break;
-
-        case 'X':
-            *string = 'x';
-            break;
-
-        case 'Y':
-            *string = 'y';
-            break;
-
-        case 'Z':
-            *string = 'z';
-            break;
-        
-        default:
-            break;
-        }
-    }
+    return (Py_ssize_t) quota;
 }
 
 #endif
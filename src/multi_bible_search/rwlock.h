@@ -0,0 +1,86 @@
+#ifndef RWLOCK_H
+#define RWLOCK_H
+
+/*
+ * Reader-writer lock over the loaded tables: searches read them without the GIL, any number at once, while loading
+ * and unloading change them one at a time.
+ * Never wait for it while holding the GIL, since whoever holds it may be waiting for the GIL to finish.
+ */
+#ifdef _WIN32
+#include <windows.h>
+
+struct rwlock
+{
+    SRWLOCK lock;
+};
+
+// Returns 0 on success
+static inline int rwlock_init(struct rwlock* lock) {
+    InitializeSRWLock(&lock->lock);
+    return 0;
+}
+
+static inline void rwlock_destroy(struct rwlock* lock) {
+    (void) lock;
+}
+
+static inline void rwlock_read(struct rwlock* lock) {
+    AcquireSRWLockShared(&lock->lock);
+}
+
+static inline void rwlock_read_unlock(struct rwlock* lock) {
+    ReleaseSRWLockShared(&lock->lock);
+}
+
+static inline void rwlock_write(struct rwlock* lock) {
+    AcquireSRWLockExclusive(&lock->lock);
+}
+
+static inline void rwlock_write_unlock(struct rwlock* lock) {
+    ReleaseSRWLockExclusive(&lock->lock);
+}
+#else
+#include <pthread.h>
+
+struct rwlock
+{
+    pthread_rwlock_t lock;
+};
+
+// Returns 0 on success
+static inline int rwlock_init(struct rwlock* lock) {
+    pthread_rwlockattr_t attributes;
+    if (pthread_rwlockattr_init(&attributes)) {
+        return -1;
+    }
+#if defined(__GLIBC__) && defined(PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP)
+    // Otherwise a steady stream of searches keeps a load waiting indefinitely
+    pthread_rwlockattr_setkind_np(&attributes, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+    int error = pthread_rwlock_init(&lock->lock, &attributes);
+    pthread_rwlockattr_destroy(&attributes);
+    return error ? -1 : 0;
+}
+
+static inline void rwlock_destroy(struct rwlock* lock) {
+    pthread_rwlock_destroy(&lock->lock);
+}
+
+static inline void rwlock_read(struct rwlock* lock) {
+    pthread_rwlock_rdlock(&lock->lock);
+}
+
+static inline void rwlock_read_unlock(struct rwlock* lock) {
+    pthread_rwlock_unlock(&lock->lock);
+}
+
+static inline void rwlock_write(struct rwlock* lock) {
+    pthread_rwlock_wrlock(&lock->lock);
+}
+
+static inline void rwlock_write_unlock(struct rwlock* lock) {
+    pthread_rwlock_unlock(&lock->lock);
+}
+#endif
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef TOKENIZE_H
+#define TOKENIZE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "cpu_features.h"
+#include "hashtable.h"
+#include "arena.h"
+
+/*
+ * Query tokenizer. A query is lowercased into a private copy in one pass, every byte that isn't an ASCII letter
+ * becoming '\0', and that copy is then swept once for its tokens: runs of letters, which are already terminated where
+ * they lie, and hashed (with hash_key's hash) along the way so that looking them up doesn't hash them again.
+ */
+
+// A token of a normalized query
+struct query_token
+{
+    const char* text;
+    uint32_t length;
+    // Where it starts in the query
+    uint32_t start;
+    uint64_t hash;
+    // Whether it's a prefix, written with a '*' after it
+    int prefix;
+};
+
+typedef void (*normalize_kernel)(const char* in, size_t length, char* out);
+
+// Lowercase letters of the input into `out`, and everything else to '\0'
+static void normalize_query_scalar(const char* in, size_t length, char* out) {
+    for (size_t i = 0; i < length; i++) {
+        uint8_t c = (uint8_t) in[i] | 0x20;
+        out[i] = (char) ((uint8_t) (c - 'a') < 26 ? c : 0);
+    }
+}
+
+#ifdef CPU_X86_SIMD
+TARGET_SSE2 static void normalize_query_sse2(const char* in, size_t length, char* out) {
+    const __m128i fold = _mm_set1_epi8(0x20),
+                  below = _mm_set1_epi8('a' - 1),
+                  above = _mm_set1_epi8('z' + 1);
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i c = _mm_or_si128(_mm_loadu_si128((const __m128i*) (in + i)), fold);
+        // Bytes past ASCII are negative, so they're below 'a' too
+        __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(c, below), _mm_cmplt_epi8(c, above));
+        _mm_storeu_si128((__m128i*) (out + i), _mm_and_si128(c, letters));
+    }
+    normalize_query_scalar(in + i, length - i, out + i);
+}
+#endif
+
+// Normalization kernel for this CPU, picked by `init_tokenizer`
+static normalize_kernel normalize_query = normalize_query_scalar;
+
+// Pick the normalization kernel. Call once before tokenizing anything
+static inline void init_tokenizer(void) {
+    normalize_query = normalize_query_scalar;
+#ifdef CPU_X86_SIMD
+    if (cpu_features() & CPU_SSE2) {
+        normalize_query = normalize_query_sse2;
+    }
+#endif
+}
+
+/*
+ * Tokenize a query of `length` bytes, its normalized copy and tokens living in the arena.
+ * Returns the tokens and their number in `*num_tokens`, or NULL if memory runs out.
+ */
+static inline struct query_token* tokenize_query(const char* query, size_t length, int* num_tokens,
+                                                 struct arena* arena) {
+    char* text = (char*) arena_alloc(arena, length + 1);
+    // Tokens are at least a letter and a separator apart
+    struct query_token* tokens = (struct query_token*) arena_alloc(arena, (length / 2 + 1) * sizeof(struct query_token));
+    if (text == NULL || tokens == NULL) {
+        return NULL;
+    }
+    normalize_query(query, length, text);
+    text[length] = '\0';
+
+    int count = 0;
+    size_t i = 0;
+    while (i < length) {
+        if (!text[i]) {
+            i++;
+            continue;
+        }
+        size_t start = i;
+        uint64_t hash = HASH_SEED;
+        for (; text[i]; i++) {
+            hash = hash_step(hash, (uint8_t) text[i]);
+        }
+        tokens[count].text = text + start;
+        tokens[count].length = (uint32_t) (i - start);
+        tokens[count].start = (uint32_t) start;
+        tokens[count].prefix = i < length && query[i] == '*';
+        tokens[count].hash = hash_finish(hash);
+        count++;
+    }
+    *num_tokens = count;
+    return tokens;
+}
+
+#endif
@@ -0,0 +1,221 @@
+#ifndef TOPK_H
+#define TOPK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "postings.h"
+#include "merge.h"
+#include "arena.h"
+#include "verses.h"
+
+/*
+ * Searches that only want the first few results don't need every verse counted. Results rank the verses with every
+ * token first, in reference order, then the rest by count, so going through the verses in order (a verse at a time
+ * over all of the lists) the best `k` so far can only be displaced by verses with a count that would rank higher.
+ *
+ * That's MaxScore: once `k` verses are found, a verse needs at least the count of the worst of them plus one (or all
+ * of the tokens) to get in, so the tokens with the smallest weights that can't add up to that between them only get
+ * looked up for verses found in the lists of the others, skipping the blocks in between. A token adds its weight at
+ * most once to a verse, which is what bounds a count. Once the worst of the `k` has every token, nothing after it can
+ * rank higher.
+ */
+
+// Largest number of results searched for this way, as the best ones so far are kept in a heap
+#ifndef TOPK_MAX_RESULTS
+#define TOPK_MAX_RESULTS 100
+#endif
+/*
+ * Most tokens times references searched for this way. A verse at a time goes through the lists of every token that
+ * could still get it in, so when the best `k` don't fill up with every token early on that's about the work, against
+ * about the references on their own (and a fixed cost for ranking every verse) when counting. Measured on KJV
+ */
+#ifndef TOPK_MAX_WORK
+#define TOPK_MAX_WORK 700000
+#endif
+
+// Whether `a` ranks after `b` for a query of `target` tokens
+static inline int topk_ranks_after(const result_pair* a, const result_pair* b, uint_fast16_t target) {
+    if ((a->count == target) != (b->count == target)) {
+        return b->count == target;
+    }
+    if (a->count != b->count) {
+        return a->count < b->count;
+    }
+    return a->element > b->element;
+}
+
+// Restore the heap (the worst ranked result at the top) below `i`
+static inline void topk_sift_down(result_pair* heap, size_t size, size_t i, uint_fast16_t target) {
+    for (;;) {
+        size_t worst = i,
+               left = 2 * i + 1,
+               right = left + 1;
+        if (left < size && topk_ranks_after(&heap[left], &heap[worst], target)) {
+            worst = left;
+        }
+        if (right < size && topk_ranks_after(&heap[right], &heap[worst], target)) {
+            worst = right;
+        }
+        if (worst == i) {
+            return;
+        }
+        result_pair tmp = heap[i];
+        heap[i] = heap[worst];
+        heap[worst] = tmp;
+        i = worst;
+    }
+}
+
+static inline void topk_sift_up(result_pair* heap, size_t i, uint_fast16_t target) {
+    while (i > 0 && topk_ranks_after(&heap[i], &heap[(i - 1) / 2], target)) {
+        result_pair tmp = heap[i];
+        heap[i] = heap[(i - 1) / 2];
+        heap[(i - 1) / 2] = tmp;
+        i = (i - 1) / 2;
+    }
+}
+
+static int compare_result_elements(const void* a, const void* b) {
+    uint32_t x = ((const result_pair*) a)->element,
+             y = ((const result_pair*) b)->element;
+    return (x > y) - (x < y);
+}
+
+// Whether a search for `max_results` is better off top-k than counting every verse
+static inline int should_search_top(const struct merge_source* sources, int num_sources, Py_ssize_t max_results) {
+    size_t total = 0;
+    int num_tokens = 0;
+    for (int i = 0; i < num_sources; i++) {
+        total += sources[i].length;
+        if (sources[i].token >= num_tokens) {
+            num_tokens = sources[i].token + 1;
+        }
+    }
+    return max_results > 0 && max_results <= TOPK_MAX_RESULTS && (size_t) max_results * 16 < total &&
+           total * (size_t) num_tokens < TOPK_MAX_WORK;
+}
+
+/*
+ * Count the `k` best ranked verses of a query of `target` tokens into `dest`, in reference order like merge_postings,
+ * so that `rank` puts them in the same order as it would among all of them.
+ * `dest` needs room for `k` results, or the total length of the sources if that's less.
+ * Returns the number of results, or -1 if memory (from the arena) runs out.
+ */
+static inline Py_ssize_t top_postings(const struct merge_source* sources, int num_sources, uint_fast16_t target,
+                                      size_t k, result_pair * restrict dest, struct arena* arena) {
+    int num_tokens = 0;
+    for (int s = 0; s < num_sources; s++) {
+        if (sources[s].token >= num_tokens) {
+            num_tokens = sources[s].token + 1;
+        }
+    }
+    struct posting_iterator* its = (struct posting_iterator*) arena_alloc(arena, (num_sources ? num_sources : 1) * sizeof(struct posting_iterator));
+    // Lists grouped by token, the tokens by weight and then most references first
+    int* order = (int*) arena_alloc(arena, (num_sources ? num_sources : 1) * sizeof(int));
+    size_t* token_lengths = (size_t*) arena_calloc(arena, num_tokens ? num_tokens : 1, sizeof(size_t));
+    // Where the lists of each token start in `order`, and the total weight of the tokens before each
+    int* token_start = (int*) arena_alloc(arena, (num_sources + 1) * sizeof(int));
+    uint32_t* bound = (uint32_t*) arena_alloc(arena, (num_sources + 1) * sizeof(uint32_t));
+    if (its == NULL || order == NULL || token_lengths == NULL || token_start == NULL || bound == NULL) {
+        return -1;
+    }
+
+    int n = 0;
+    for (int s = 0; s < num_sources; s++) {
+        token_lengths[sources[s].token] += sources[s].length;
+    }
+    for (int s = 0; s < num_sources; s++) {
+        if (sources[s].length == 0) {
+            continue;
+        }
+        iterator_init(&its[s], sources[s].postings, sources[s].length);
+        int i = n++;
+        for (; i > 0; i--) {
+            const struct merge_source* prev = &sources[order[i - 1]];
+            size_t prev_length = token_lengths[prev->token],
+                   length = token_lengths[sources[s].token];
+            if (prev->weight < sources[s].weight ||
+                (prev->weight == sources[s].weight &&
+                 (prev_length > length || (prev_length == length && prev->token <= sources[s].token)))) {
+                break;
+            }
+            order[i] = order[i - 1];
+        }
+        order[i] = s;
+    }
+    int num_terms = 0;
+    bound[0] = 0;
+    for (int i = 0; i < n; i++) {
+        if (i == 0 || sources[order[i]].token != sources[order[i - 1]].token) {
+            token_start[num_terms] = i;
+            bound[num_terms + 1] = bound[num_terms] + (uint32_t) sources[order[i]].weight;
+            num_terms++;
+        }
+    }
+    token_start[num_terms] = n;
+
+    size_t size = 0;
+    // Count a verse needs to get in, and the first token it has to have (those before can't add up to that)
+    uint32_t needed = 1;
+    int essential = 0;
+    while (essential < num_terms) {
+        uint32_t verse = NO_VERSE;
+        for (int i = token_start[essential]; i < n; i++) {
+            if (its[order[i]].verse < verse) {
+                verse = its[order[i]].verse;
+            }
+        }
+        if (verse == NO_VERSE) {
+            break;
+        }
+        uint32_t count = 0;
+        for (int i = token_start[essential]; i < n; i++) {
+            struct posting_iterator* it = &its[order[i]];
+            if (it->verse == verse) {
+                count += (uint32_t) sources[order[i]].weight;
+                iterator_next(it);
+            }
+        }
+        // Look it up in the lists of the other tokens, as long as it can still get enough
+        for (int t = essential - 1; t >= 0 && count + bound[t + 1] >= needed; t--) {
+            for (int i = token_start[t]; i < token_start[t + 1]; i++) {
+                if (iterator_seek(&its[order[i]], verse) == verse) {
+                    count += (uint32_t) sources[order[i]].weight;
+                    break;
+                }
+            }
+        }
+        if (count < needed) {
+            continue;
+        }
+
+        if (size < k) {
+            dest[size] = (result_pair) {verse, count};
+            topk_sift_up(dest, size++, target);
+        }
+        // Later verses only displace the worst with all of the tokens or more of them
+        else if (count == target || count > dest[0].count) {
+            dest[0] = (result_pair) {verse, count};
+            topk_sift_down(dest, size, 0, target);
+        }
+        else {
+            continue;
+        }
+        if (size == k) {
+            if (dest[0].count == target) {
+                break;
+            }
+            needed = dest[0].count + 1 < target ? (uint32_t) dest[0].count + 1 : (uint32_t) target;
+            while (essential < num_terms && bound[essential + 1] < needed) {
+                essential++;
+            }
+        }
+    }
+
+    qsort(dest, size, sizeof(result_pair), compare_result_elements);
+    return (Py_ssize_t) size;
+}
+
+#endif
@@ -1,6 +1,8 @@
 """
 Translation layer
 """
+import bisect
+from typing import Dict, List, Tuple
 
 books = {
         'Genesis': 1, 'Exodus': 2, 'Leviticus': 3, 'Numbers': 4, 'Deuteronomy': 5, 'Joshua': 6,
@@ -35,24 +37,147 @@ rbooks = {
     }
 
 
+# Versification shared by every version: the number of verses of each chapter of each book, taken as the most any
+# version has. Every verse is numbered densely, in reference order, from 0 (its verse ID), which is what the indexes
+# hold. This matches verses.h.
+chapter_verses = {
+        1: (31, 25, 24, 26, 32, 22, 24, 22, 29, 32, 32, 20, 18, 24, 21, 16, 27, 33, 38, 18, 34, 24,
+            20, 67, 34, 35, 46, 22, 35, 43, 55, 32, 20, 31, 29, 43, 36, 30, 23, 23, 57, 38, 34, 34,
+            28, 34, 31, 22, 33, 26),
+        2: (22, 25, 22, 31, 23, 30, 25, 32, 35, 29, 10, 51, 22, 31, 27, 36, 16, 27, 25, 26, 36, 31,
+            33, 18, 40, 37, 21, 43, 46, 38, 18, 35, 23, 35, 35, 38, 29, 31, 43, 38),
+        3: (17, 16, 17, 35, 19, 30, 38, 36, 24, 20, 47, 8, 59, 57, 33, 34, 16, 30, 37, 27, 24, 33,
+            44, 23, 55, 46, 34),
+        4: (54, 34, 51, 49, 31, 27, 89, 26, 23, 36, 35, 16, 34, 45, 41, 50, 13, 32, 22, 30, 35, 41,
+            30, 25, 18, 65, 23, 31, 40, 17, 54, 42, 56, 29, 34, 13),
+        5: (46, 37, 29, 49, 33, 25, 26, 20, 29, 22, 32, 32, 18, 29, 23, 22, 20, 22, 21, 20, 23, 30,
+            25, 22, 19, 19, 26, 68, 29, 20, 30, 52, 29, 12),
+        6: (18, 24, 17, 25, 16, 27, 26, 35, 27, 43, 23, 24, 33, 15, 63, 10, 18, 28, 51, 9, 45, 34,
+            16, 33),
+        7: (36, 23, 31, 24, 32, 40, 25, 35, 57, 18, 40, 15, 25, 20, 20, 31, 13, 31, 30, 48, 25),
+        8: (22, 23, 18, 22),
+        9: (28, 36, 21, 22, 12, 21, 17, 22, 27, 27, 15, 25, 23, 52, 35, 23, 58, 30, 24, 43, 15, 23,
+            29, 23, 44, 25, 12, 25, 11, 31, 13),
+        10: (27, 32, 39, 12, 25, 23, 29, 18, 13, 19, 27, 31, 39, 33, 37, 23, 29, 33, 43, 26, 22, 51,
+             39, 25),
+        11: (53, 46, 28, 34, 18, 38, 51, 66, 28, 29, 43, 33, 34, 31, 34, 34, 24, 46, 21, 43, 29, 54),
+        12: (18, 25, 27, 44, 27, 33, 20, 29, 37, 36, 21, 21, 25, 29, 38, 20, 41, 37, 37, 21, 26, 20,
+             37, 20, 30),
+        13: (54, 55, 24, 43, 26, 81, 40, 40, 44, 14, 47, 40, 14, 17, 29, 43, 27, 17, 19, 8, 30, 19,
+             32, 31, 31, 32, 34, 21, 30),
+        14: (17, 18, 17, 22, 14, 42, 22, 18, 31, 19, 23, 16, 22, 15, 19, 14, 19, 34, 11, 37, 20, 12,
+             21, 27, 28, 23, 9, 27, 36, 27, 21, 33, 25, 33, 27, 23),
+        15: (11, 70, 13, 24, 17, 22, 28, 36, 15, 44),
+        16: (11, 20, 32, 23, 19, 19, 73, 18, 38, 39, 36, 47, 31),
+        17: (22, 23, 15, 17, 14, 14, 10, 17, 32, 13),
+        18: (22, 13, 26, 21, 27, 30, 21, 22, 35, 22, 20, 25, 28, 22, 35, 23, 16, 21, 29, 29, 34, 30,
+             17, 25, 6, 14, 23, 28, 25, 31, 40, 22, 33, 37, 16, 33, 24, 41, 38, 28, 34, 17),
+        19: (6, 13, 9, 10, 13, 11, 18, 10, 39, 18, 9, 8, 7, 7, 11, 15, 51, 50, 14, 14, 32, 31, 10,
+             22, 22, 14, 14, 10, 13, 25, 24, 22, 23, 28, 28, 40, 40, 22, 18, 17, 13, 11, 26, 26, 17,
+             11, 15, 21, 23, 23, 19, 9, 9, 24, 23, 13, 12, 18, 17, 12, 13, 12, 11, 14, 20, 20, 36,
+             37, 36, 24, 24, 28, 28, 23, 13, 21, 72, 72, 20, 19, 16, 19, 18, 14, 17, 17, 19, 53, 52,
+             17, 16, 15, 23, 23, 13, 13, 12, 9, 9, 8, 29, 28, 35, 45, 48, 48, 43, 31, 31, 10, 10,
+             10, 26, 9, 18, 19, 29, 176, 176, 8, 9, 9, 8, 8, 7, 6, 6, 8, 8, 8, 18, 18, 3, 21, 27,
+             26, 9, 24, 24, 13, 10, 12, 15, 21, 21, 11, 20, 14, 9, 6),
+        20: (33, 22, 35, 27, 23, 35, 27, 36, 18, 32, 31, 28, 25, 35, 33, 33, 28, 24, 29, 30, 31, 29,
+             35, 34, 28, 28, 27, 28, 27, 33, 31),
+        21: (18, 26, 22, 17, 20, 12, 31, 17, 18, 20, 10, 14),
+        22: (17, 17, 11, 16, 17, 13, 13, 14),
+        23: (31, 22, 26, 6, 30, 13, 25, 22, 21, 34, 16, 6, 22, 32, 9, 14, 14, 7, 25, 6, 17, 25, 18,
+             23, 12, 21, 13, 29, 24, 33, 45, 20, 24, 17, 10, 22, 38, 22, 8, 31, 29, 25, 28, 28, 26,
+             13, 15, 22, 26, 11, 23, 15, 12, 17, 13, 12, 21, 14, 21, 22, 11, 12, 19, 12, 25, 24),
+        24: (19, 37, 25, 31, 31, 30, 34, 22, 26, 25, 23, 17, 27, 22, 21, 21, 27, 23, 15, 18, 14, 30,
+             40, 10, 38, 24, 22, 17, 32, 24, 40, 44, 26, 22, 19, 32, 21, 28, 18, 16, 18, 22, 13, 30,
+             5, 28, 7, 47, 39, 46, 64, 34),
+        25: (22, 22, 66, 22, 22),
+        26: (29, 10, 27, 17, 17, 14, 27, 18, 11, 22, 25, 28, 23, 23, 8, 63, 24, 32, 14, 49, 32, 31,
+             49, 27, 17, 21, 36, 26, 21, 26, 18, 32, 46, 48, 15, 38, 28, 23, 29, 49, 26, 20, 27, 31,
+             25, 24, 23, 35),
+        27: (21, 49, 100, 37, 31, 28, 28, 27, 27, 21, 45, 13),
+        28: (11, 24, 5, 19, 15, 11, 16, 14, 17, 15, 12, 14, 16, 10),
+        29: (20, 32, 21),
+        30: (15, 16, 15, 13, 27, 15, 17, 14, 15),
+        31: (21,),
+        32: (17, 11, 10, 11),
+        33: (16, 13, 12, 13, 15, 16, 20),
+        34: (15, 13, 19),
+        35: (17, 20, 19),
+        36: (18, 15, 20),
+        37: (15, 24),
+        38: (21, 13, 10, 14, 11, 15, 14, 23, 17, 12, 114, 14, 9, 21),
+        39: (14, 17, 18, 6),
+        40: (25, 23, 17, 25, 48, 34, 29, 34, 38, 42, 30, 50, 58, 36, 39, 28, 27, 35, 30, 34, 46, 46,
+             39, 51, 46, 75, 66, 20),
+        41: (45, 28, 35, 41, 43, 56, 37, 39, 50, 52, 33, 44, 37, 72, 47, 20),
+        42: (80, 52, 38, 44, 39, 49, 50, 56, 62, 42, 54, 59, 35, 35, 32, 31, 37, 43, 48, 47, 38, 71,
+             56, 53),
+        43: (51, 25, 36, 54, 47, 72, 53, 59, 41, 42, 57, 50, 38, 31, 27, 33, 26, 40, 42, 31, 25),
+        44: (26, 47, 26, 37, 42, 15, 60, 40, 43, 48, 30, 25, 52, 28, 41, 40, 34, 28, 41, 38, 40, 30,
+             35, 27, 27, 32, 44, 31),
+        45: (32, 29, 31, 25, 21, 23, 25, 39, 33, 21, 36, 21, 14, 26, 33, 27),
+        46: (31, 16, 23, 21, 13, 20, 40, 13, 27, 33, 34, 31, 13, 40, 58, 24),
+        47: (24, 17, 18, 18, 21, 18, 16, 24, 15, 18, 33, 21, 14),
+        48: (24, 21, 29, 31, 26, 18),
+        49: (23, 22, 21, 32, 33, 24),
+        50: (30, 30, 21, 23),
+        51: (29, 23, 25, 18),
+        52: (10, 20, 13, 18, 28),
+        53: (12, 17, 18),
+        54: (20, 15, 16, 16, 25, 21),
+        55: (18, 26, 17, 22),
+        56: (16, 15, 15),
+        57: (25,),
+        58: (14, 18, 19, 16, 14, 20, 28, 13, 28, 39, 40, 29, 25),
+        59: (27, 26, 18, 17, 20),
+        60: (25, 25, 22, 19, 14),
+        61: (21, 22, 18),
+        62: (10, 29, 24, 21, 21),
+        63: (13,),
+        64: (15,),
+        65: (25,),
+        66: (20, 29, 22, 11, 14, 17, 17, 13, 21, 11, 19, 18, 18, 20, 8, 21, 18, 24, 21, 15, 27, 21),
+    }
+
+def _chapter_starts() -> List[Tuple[int, int, int]]:
+    """
+    List where each chapter starts in verse IDs.
+    :return: The verse ID of verse 1, book, and chapter of each chapter, in order.
+    """
+    starts = []
+    verse_id = 0
+    for book, verses in chapter_verses.items():
+        for chapter, count in enumerate(verses, 1):
+            starts.append((verse_id, book, chapter))
+            verse_id += count
+    return starts
+
+
+# Verse ID of verse 1 of each chapter, and the book and chapter at each of them
+chapter_starts: List[int] = [start for start, _, _ in _chapter_starts()]
+chapter_keys: List[Tuple[int, int]] = [(book, chapter) for _, book, chapter in _chapter_starts()]
+first_verses: Dict[Tuple[int, int], int] = dict(zip(chapter_keys, chapter_starts))
+
+
 def translate(book: str, chapter: int, verse: int) -> int:
     """
-    Get the (from 1) index of a book of the Bible.
+    Get the verse ID of a reference.
     :param book: The book name.
     :param chapter: The chapter reference.
     :param verse: The verse reference.
-    :return: Index of the book.
+    :return: The verse ID.
     """
     # quick bounds check
-    assert verse <= 176
-    assert chapter <= 150
-    return books[book] * 1_000_000 + chapter * 1_000 + verse
+    book_index = books[book]
+    assert 1 <= chapter <= len(chapter_verses[book_index])
+    assert 1 <= verse <= chapter_verses[book_index][chapter - 1]
+    return first_verses[(book_index, chapter)] + verse - 1
 
 
-def rtranslate(reference: int) -> str:
+def rtranslate(verse_id: int) -> str:
     """
-    Gets the name of a book based on its index. Opposite of translate()
-    :param reference: The reference to translate.
+    Gets the reference of a verse ID as a string. Opposite of translate()
+    :param verse_id: The verse ID to translate.
     :return: The reference as a string.
     """
-    return f"{rbooks[reference // 1_000_000]} {reference // 1_000 % 1_000}:{reference % 1000}"
+    book, chapter = chapter_keys[bisect.bisect_right(chapter_starts, verse_id) - 1]
+    return f"{rbooks[book]} {chapter}:{verse_id - first_verses[(book, chapter)] + 1}"
@@ -1,11 +1,22 @@
 """
 Test the functionality of the search module.
 """
+import bz2
+import os
+import struct
+import subprocess
+import sys
+import tempfile
+import threading
 import unittest
+from unittest import mock
 
 # pylint: disable=import-error
+from src.multi_bible_search import bible_search_adapter
 from src.multi_bible_search.bible_search_adapter import BibleSearch
+from src.multi_bible_search.multi_bible_search import BibleSearch as cBibleSearch
 from src.multi_bible_search.invalid_version import InvalidVersion
+from src.multi_bible_search.translate import books, chapter_starts, rtranslate, translate
 
 
 class TestSearch(unittest.TestCase):
@@ -182,6 +193,656 @@ class TestSearch(unittest.TestCase):
         # This should be skipped and not cause an error
         self.bible_search.load("KJV")
 
+    def test_binary_index(self):
+        """
+        Make sure that a binary index file searches the same as the JSON index it came from.
+        :return: None.
+        """
+        data_path = os.path.join(os.path.dirname(__file__), "..", "src", "multi_bible_search", "data")
+        json_search = cBibleSearch()
+        for version in ("AllEng", "KJV-like", "KJV"):
+            with bz2.open(
+                    os.path.join(data_path, f"{version}.json.pbz2"), "rt", encoding="utf-8"
+            ) as data_file:
+                json_search.load(data_file.read(), version)
+
+        binary_search = cBibleSearch()
+        with tempfile.TemporaryDirectory() as temp_dir:
+            for version in ("AllEng", "KJV-like", "KJV"):
+                index_path = os.path.join(temp_dir, f"{version}.idx")
+                json_search.save_index(version, index_path)
+                binary_search.load_index(index_path, version)
+
+            for query in ("Jesus wept", "comest goest", "notawordinthebible", "a"):
+                self.assertEqual(
+                    json_search.search(query, "KJV"), binary_search.search(query, "KJV")
+                )
+            binary_search.unload("KJV")
+
+            # Garbage and missing files are rejected
+            bad_path = os.path.join(temp_dir, "bad.idx")
+            with open(bad_path, "wb") as bad_file:
+                bad_file.write(b"not an index" * 8)
+            with self.assertRaises(RuntimeError):
+                binary_search.load_index(bad_path, "KJV")
+            with self.assertRaises(OSError):
+                binary_search.load_index(os.path.join(temp_dir, "missing.idx"), "KJV")
+            del binary_search
+
+    def test_corrupt_index(self):
+        """
+        Make sure that index files whose posting lists don't hold up are rejected rather than searched.
+        :return: None.
+        """
+        data_path = os.path.join(os.path.dirname(__file__), "..", "src", "multi_bible_search", "data")
+        json_search = cBibleSearch()
+        for version in ("AllEng", "KJV-like", "KJV"):
+            json_search.load_file(os.path.join(data_path, f"{version}.json.pbz2"), version)
+
+        with tempfile.TemporaryDirectory() as temp_dir:
+            index_path = os.path.join(temp_dir, "KJV.idx")
+            json_search.save_index("KJV", index_path)
+            with open(index_path, "rb") as index_file:
+                index = index_file.read()
+            # struct index_header, then 32-byte elements of a 24-byte key, offset and length
+            num_terms, _, terms_offset, postings_offset, postings_size = struct.unpack_from("<5I", index, 8)
+            length_offset = terms_offset + 28
+
+            corruptions = {
+                # Deltas that run past the verses
+                "postings.idx": index[:postings_offset] + b"\xff" * postings_size + index[postings_offset + postings_size:],
+                # A list longer than its storage
+                "length.idx": index[:length_offset] + struct.pack("<I", 30000) + index[length_offset + 4:],
+                # A list longer than there are verses
+                "verses.idx": index[:length_offset] + struct.pack("<I", 40000) + index[length_offset + 4:],
+            }
+            self.assertGreater(num_terms, 1)
+            for name, corrupted in corruptions.items():
+                corrupted_path = os.path.join(temp_dir, name)
+                with open(corrupted_path, "wb") as corrupted_file:
+                    corrupted_file.write(corrupted)
+                with self.assertRaises(RuntimeError, msg=name):
+                    cBibleSearch().load_index(corrupted_path, "KJV")
+
+            # The untouched file still loads
+            cBibleSearch().load_index(index_path, "KJV")
+
+    def test_index_cache_dir(self):
+        """
+        Make sure that binary indexes fall back to a per-user cache directory when the package directory can't be
+        written to, and are loaded from there next time.
+        :return: None.
+        """
+        with tempfile.TemporaryDirectory() as temp_dir:
+            # Nothing can be made under a file, even by root
+            blocked_path = os.path.join(temp_dir, "blocked")
+            with open(blocked_path, "wb"):
+                pass
+            cache_path = os.path.join(temp_dir, "cache")
+            with mock.patch.object(bible_search_adapter, "_index_dirs", return_value=[
+                    os.path.join(blocked_path, "data"), cache_path
+            ]):
+                cached_search = BibleSearch()
+                self.assertEqual(cached_search.search("Jesus wept"), self.bible_search.search("Jesus wept"))
+                self.assertEqual(sorted(os.listdir(cache_path)), ["AllEng.idx", "KJV-like.idx", "KJV.idx"])
+
+                # Loaded from the cache rather than saved again
+                modified = os.path.getmtime(os.path.join(cache_path, "KJV.idx"))
+                self.assertEqual(BibleSearch().search("Jesus wept"), self.bible_search.search("Jesus wept"))
+                self.assertEqual(os.path.getmtime(os.path.join(cache_path, "KJV.idx")), modified)
+
+            if sys.platform != "win32":
+                with mock.patch.dict(os.environ, {"XDG_CACHE_HOME": temp_dir}):
+                    self.assertEqual(bible_search_adapter._index_dirs()[1], os.path.join(temp_dir, "multi_bible_search"))
+
+    def test_load_file(self):
+        """
+        Make sure that loading a compressed index in C matches loading the decompressed string.
+        :return: None.
+        """
+        data_path = os.path.join(os.path.dirname(__file__), "..", "src", "multi_bible_search", "data")
+        string_search = cBibleSearch()
+        file_search = cBibleSearch()
+        for version in ("AllEng", "KJV-like", "KJV"):
+            json_path = os.path.join(data_path, f"{version}.json.pbz2")
+            with bz2.open(json_path, "rt", encoding="utf-8") as data_file:
+                string_search.load(data_file.read(), version)
+            file_search.load_file(json_path, version)
+
+        for query in ("Jesus wept", "comest goest", "notawordinthebible", "a"):
+            self.assertEqual(string_search.search(query, "KJV"), file_search.search(query, "KJV"))
+        self.assertEqual(string_search.index_size(), file_search.index_size())
+
+        with tempfile.TemporaryDirectory() as temp_dir:
+            # Truncated files are rejected rather than half loaded
+            with open(os.path.join(data_path, "KJV.json.pbz2"), "rb") as data_file:
+                truncated = data_file.read()[:100_000]
+            truncated_path = os.path.join(temp_dir, "truncated.json.pbz2")
+            with open(truncated_path, "wb") as truncated_file:
+                truncated_file.write(truncated)
+            with self.assertRaises(RuntimeError):
+                cBibleSearch().load_file(truncated_path, "KJV")
+            with self.assertRaises(OSError):
+                cBibleSearch().load_file(os.path.join(temp_dir, "missing.json.pbz2"), "KJV")
+
+    def test_threaded_search(self):
+        """
+        Make sure that searches from several threads at once, while another version loads and unloads, get the same
+        results as one at a time.
+        :return: None.
+        """
+        data_path = os.path.join(os.path.dirname(__file__), "..", "src", "multi_bible_search", "data")
+        search = cBibleSearch()
+        for version in ("AllEng", "KJV-like", "KJV"):
+            search.load_file(os.path.join(data_path, f"{version}.json.pbz2"), version)
+        queries = [
+            "Jesus wept", "the lord", "and the lord said unto moses",
+            "in the beginning God created the heaven and the earth"
+        ]
+        expected = {
+            (query, max_results): search.search(query, "KJV", max_results)
+            for query in queries for max_results in (10, 1000)
+        }
+        failures = []
+
+        def search_loop():
+            for _ in range(20):
+                for (query, max_results), results in expected.items():
+                    if search.search(query, "KJV", max_results) != results:
+                        failures.append((query, max_results))
+
+        def load_loop():
+            for _ in range(3):
+                search.load_file(os.path.join(data_path, "BBE.json.pbz2"), "BBE")
+                search.search("the lord", "BBE")
+                search.unload("BBE")
+
+        threads = [threading.Thread(target=search_loop) for _ in range(4)]
+        threads.append(threading.Thread(target=load_loop))
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        self.assertEqual(failures, [])
+
+    def test_search_ids(self):
+        """
+        Make sure that searching for verse IDs gets the same results as searching for references, in a buffer.
+        :return: None.
+        """
+        for query in ("Jesus wept", "the lord", "And the LORD said unto Moses", ""):
+            for max_results in (10, 1000, sys.maxsize):
+                ids = self.bible_search.search_ids(query, "KJV", max_results)
+                view = memoryview(ids)
+                self.assertEqual((view.format, view.itemsize, view.readonly), ("I", 4, True))
+                self.assertEqual(len(ids), len(view))
+                self.assertEqual([rtranslate(verse) for verse in view],
+                                 self.bible_search.search(query, "KJV", max_results))
+
+        ids, counts = self.bible_search.search_ids("the lord said unto moses", "KJV", with_counts=True)
+        counts = memoryview(counts).tolist()
+        self.assertEqual(len(counts), len(ids))
+        # Those with every token first, then the rest by count
+        full = counts.count(5)
+        self.assertEqual(counts[:full], [5] * full)
+        self.assertEqual(counts[full:], sorted(counts[full:], reverse=True))
+
+    def test_search_boolean(self):
+        """
+        Make sure that boolean searches get the verses with every word and none of the excluded ones.
+        :return: None.
+        """
+        def verses(word: str, version: str) -> set:
+            return set(memoryview(self.bible_search.search_ids(word, version)).tolist())
+
+        queries = [
+            (["jesus", "wept"], []),
+            (["the", "lord", "said", "unto", "moses"], []),
+            (["melchizedek", "the", "and", "of"], []),
+            (["love"], ["the"]),
+            (["god", "lord"], ["the", "and"]),
+            (["faith", "hope", "charity"], ["notawordinthebible"]),
+        ]
+        for version in ("KJV", "ESV", "RV1960"):
+            for required, excluded in queries:
+                query = " ".join(required + [f"-{word}" for word in excluded])
+                expected = set.intersection(*(verses(word, version) for word in required))
+                for word in excluded:
+                    expected -= verses(word, version)
+                expected = [rtranslate(verse) for verse in sorted(expected)]
+                with self.subTest(version=version, query=query):
+                    self.assertEqual(self.bible_search.search_boolean(query, version), expected)
+                    self.assertEqual(self.bible_search.search_boolean(query, version, 3), expected[:3])
+
+        # Every verse with all the tokens is first in the ranked search, like these
+        ranked = self.bible_search.search("the lord said unto moses", "KJV")
+        boolean = self.bible_search.search_boolean("moses unto said lord the the", "KJV")
+        self.assertEqual(sorted(ranked[:len(boolean)], key=translate_reference), boolean)
+
+        self.assertEqual(self.bible_search.search_boolean("jesus -jesus", "KJV"), [])
+        self.assertEqual(self.bible_search.search_boolean("-jesus", "KJV"), [])
+        self.assertEqual(self.bible_search.search_boolean("jesus notawordinthebible", "KJV"), [])
+        self.assertEqual(self.bible_search.search_boolean("", "KJV"), [])
+        # Only a dash starting a word excludes it
+        self.assertEqual(self.bible_search.search_boolean("Jesus wept-", "KJV"),
+                         self.bible_search.search_boolean("jesus wept", "KJV"))
+        self.assertEqual(self.bible_search.search_boolean("Jesus-wept", "KJV"),
+                         self.bible_search.search_boolean("jesus wept", "KJV"))
+
+    def test_prefix_query(self):
+        """
+        Make sure that a prefix matches every word that starts with it, like searching for each of them would.
+        :return: None.
+        """
+        with open(os.path.join(os.path.dirname(__file__), "kjv_keys.txt"), "r", encoding="utf-8") as key_file:
+            keys = key_file.read().split()
+
+        def verses(word: str) -> set:
+            return set(memoryview(self.bible_search.search_ids(word, "KJV")).tolist())
+
+        for prefix in ("bless", "prophe", "jesu", "a", "notawordinthebible"):
+            expected = set()
+            for key in keys:
+                if key.startswith(prefix):
+                    expected |= verses(key)
+            with self.subTest(prefix=prefix):
+                # A verse counts once, however many of the words it has
+                self.assertEqual(memoryview(self.bible_search.search_ids(f"{prefix}*", "KJV")).tolist(),
+                                 sorted(expected))
+                self.assertEqual(self.bible_search.search_boolean(f"jesus {prefix}*", "KJV"),
+                                 [rtranslate(verse) for verse in sorted(expected & verses("jesus"))])
+
+        ids, counts = self.bible_search.search_ids("jesus bless* bless", "KJV", with_counts=True)
+        counts = dict(zip(memoryview(ids).tolist(), memoryview(counts).tolist()))
+        blessed = set.union(*(verses(key) for key in keys if key.startswith("bless")))
+        for verse in verses("jesus") | blessed:
+            self.assertEqual(counts[verse], (verse in verses("jesus")) + (verse in blessed) + (verse in verses("bless")))
+        for max_results in (1, 10, 50):
+            self.assertEqual(self.bible_search.search("jesus bless* bless", "KJV", max_results),
+                             self.bible_search.search("jesus bless* bless", "KJV")[:max_results])
+
+        # A prefix isn't the word itself, in the cache either
+        search = BibleSearch(cache_size=1 << 20)
+        self.assertNotEqual(search.search("bless", "KJV"), search.search("bless*", "KJV"))
+        self.assertNotEqual(search.search("bless*", "KJV"), search.search("bless", "KJV"))
+
+    def test_search_many(self):
+        """
+        Make sure that a batch of searches over several threads gets the same results as searching one at a time.
+        :return: None.
+        """
+        queries = [
+            "Jesus wept", "the lord", "And the LORD said unto Moses", "love", "", "faith hope charity",
+            "in the beginning God created the heaven and the earth"
+        ] * 5
+        for max_results in (10, 1000, sys.maxsize):
+            expected = [self.bible_search.search(query, "KJV", max_results) for query in queries]
+            for threads in (1, 4, None):
+                self.assertEqual(self.bible_search.search_many(queries, "KJV", max_results, threads), expected)
+        self.assertEqual(self.bible_search.search_many(iter(queries[:2]), "ESV"),
+                         [self.bible_search.search(query, "ESV") for query in queries[:2]])
+        self.assertEqual(self.bible_search.search_many([]), [])
+        with self.assertRaises(TypeError):
+            self.bible_search.search_many(["Jesus wept", 1])
+
+    def test_search_versions(self):
+        """
+        Make sure that searching many versions at once gets the same results as searching each one.
+        :return: None.
+        """
+        versions = ["KJV", "AKJV", "ESV", "NIV 2011", "BBE", "RV1960"]
+        for query in ("Jesus wept", "the lord", "In the beginning God created the heaven and the earth", "amor", ""):
+            for max_results in (10, sys.maxsize):
+                for threads in (1, 3, None):
+                    self.assertEqual(
+                        self.bible_search.search_versions(query, versions, max_results, threads),
+                        {version: self.bible_search.search(query, version, max_results) for version in versions}
+                    )
+        self.assertEqual(self.bible_search.search_versions("Jesus wept", []), {})
+        with self.assertRaises(InvalidVersion):
+            self.bible_search.search_versions("Jesus wept", ["KJV", "KJV 2"])
+
+    def test_result_strings(self):
+        """
+        Make sure that every search returns the same reference string objects, which are interned.
+        :return: None.
+        """
+        first = self.bible_search.search("the lord", "KJV")
+        second = self.bible_search.search_many(["the lord"], "KJV")[0]
+        self.assertEqual(first, second)
+        self.assertTrue(all(a is b for a, b in zip(first, second)))
+        self.assertIs(first[0], sys.intern(first[0].encode().decode()))
+
+    def test_result_cache(self):
+        """
+        Make sure that cached results are the same as searched ones, and that they're dropped as versions change.
+        :return: None.
+        """
+        queries = ["Jesus wept", "wept Jesus", "the lord", "And the LORD said unto Moses", "love"]
+        expected = {
+            (query, max_results): self.bible_search.search(query, "KJV", max_results)
+            for query in queries for max_results in (10, sys.maxsize)
+        }
+        cached = BibleSearch(cache_size=1 << 20)
+        for _ in range(2):
+            for (query, max_results), results in expected.items():
+                self.assertEqual(cached.search(query, "KJV", max_results), results)
+        info = cached.cache_info()
+        # Only the first round misses, and "wept Jesus" not even then
+        self.assertEqual((info["hits"], info["misses"]), (12, 8))
+        self.assertLessEqual(info["bytes"], info["max_bytes"])
+
+        cached.unload_version("KJV")
+        self.assertEqual(cached.cache_info()["entries"], 0)
+        self.assertEqual(cached.search("Jesus wept", "KJV"), expected[("Jesus wept", sys.maxsize)])
+
+        # Too small for anything
+        cached.set_cache_size(16)
+        cached.search("the lord", "KJV")
+        self.assertEqual(cached.cache_info()["entries"], 0)
+        cached.set_cache_size(0)
+        self.assertEqual(cached.cache_info()["max_bytes"], 0)
+        with self.assertRaises(ValueError):
+            cached.set_cache_size(-1)
+
+    def test_broad_query(self):
+        """
+        Make sure that queries broad enough to be counted per verse rank the same as merged ones.
+        :return: None.
+        """
+        # Verses 1 and 2 of every chapter
+        verses = sorted(start + verse for start in chapter_starts for verse in (0, 1))
+        # Enough postings in enough lists to be counted per verse
+        tokens = [
+            "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel", "india", "juliett"
+        ]
+        postings = {
+            token: [verse for j, verse in enumerate(verses) if j % (i + 2)]
+            for i, token in enumerate(tokens)
+        }
+
+        counts = {}
+        for token_verses in postings.values():
+            for verse in token_verses:
+                counts[verse] = counts.get(verse, 0) + 1
+        expected = [
+            rtranslate(v)
+            for v in sorted(counts, key=lambda v: (counts[v] != len(tokens), -counts[v], v))
+        ]
+
+        search = cBibleSearch()
+        search.load(encode_index(postings), "KJV")
+        self.assertEqual(search.search(" ".join(tokens), "KJV"), expected)
+
+    def test_bitmap_query(self):
+        """
+        Make sure that tokens in most verses, stored as bitmaps, rank the same merged, accumulated, and repeated.
+        :return: None.
+        """
+        num_verses = translate("Revelation", 22, 21) + 1
+        postings = {
+            "common": [verse for verse in range(num_verses) if verse % 3],
+            "frequent": list(range(0, num_verses, 2)),
+            "rare": list(range(0, num_verses // 2, 7)),
+        }
+        search = cBibleSearch()
+        search.load(encode_index(postings), "KJV")
+
+        for query in ("common frequent", "common frequent rare", "rare " + "common " * 20 + "frequent"):
+            with self.subTest(query=query):
+                tokens = query.split()
+                counts = {}
+                for token in tokens:
+                    for verse in postings[token]:
+                        counts[verse] = counts.get(verse, 0) + 1
+                expected = [
+                    rtranslate(v)
+                    for v in sorted(counts, key=lambda v: (counts[v] != len(tokens), -counts[v], v))
+                ]
+                self.assertEqual(search.search(query, "KJV"), expected)
+
+    def test_repeated_tokens(self):
+        """
+        Make sure that repeated tokens count once for every time they're in the query, wherever they are in it.
+        :return: None.
+        """
+        postings = {
+            "alpha": list(range(0, 3000, 2)),
+            "bravo": list(range(0, 3000, 3)),
+            "charlie": list(range(0, 3000, 5)),
+            "delta": list(range(0, 3000, 7)),
+        }
+        search = cBibleSearch()
+        search.load(encode_index(postings), "KJV")
+
+        for query in (
+            "alpha alpha bravo",
+            "alpha bravo alpha charlie",
+            # Long queries rank verses with every distinct token first
+            "alpha alpha alpha bravo bravo charlie delta delta delta delta alpha bravo charlie charlie alpha delta",
+        ):
+            tokens = query.split()
+            target = len(set(tokens)) if len(tokens) > 15 else len(tokens)
+            counts = {}
+            for token in tokens:
+                for verse in postings[token]:
+                    counts[verse] = counts.get(verse, 0) + 1
+            expected = [
+                rtranslate(v)
+                for v in sorted(counts, key=lambda v: (counts[v] != target, -counts[v], v))
+            ]
+            for words in (tokens, sorted(tokens), tokens[::-1]):
+                for max_results in (10, sys.maxsize):
+                    with self.subTest(query=" ".join(words), max_results=max_results):
+                        self.assertEqual(search.search(" ".join(words), "KJV", max_results), expected[:max_results])
+
+    def test_max_results(self):
+        """
+        Make sure that searches for the first few results get the same ones, in the same order, as the full search.
+        :return: None.
+        """
+        queries = [
+            "Jesus wept",
+            "the lord",
+            "and the lord said unto moses",
+            "in the beginning God created the heaven and the earth",
+            "hospitality, a lover of good men, sober, just, holy, temperate",
+        ]
+        for version in ("KJV", "ESV", "RV1960"):
+            for query in queries:
+                full = self.bible_search.search(query, version)
+                for max_results in (1, 10, 50):
+                    with self.subTest(version=version, query=query, max_results=max_results):
+                        self.assertEqual(self.bible_search.search(query, version, max_results), full[:max_results])
+
+        # The only verses with every token are the last ones, after many blocks of verses with fewer
+        num_verses = translate("Revelation", 22, 21) + 1
+        postings = {
+            "alpha": list(range(0, num_verses - 6, 6)) + [num_verses - 1],
+            "bravo": list(range(1, num_verses - 6, 6)) + [num_verses - 2, num_verses - 1],
+            "charlie": list(range(2, num_verses - 6, 6)) + [num_verses - 2, num_verses - 1],
+        }
+        search = cBibleSearch()
+        search.load(encode_index(postings), "KJV")
+        full = search.search("alpha bravo charlie", "KJV")
+        self.assertEqual(full[0], rtranslate(num_verses - 1))
+        for max_results in (1, 2, 10, 100):
+            with self.subTest(max_results=max_results):
+                self.assertEqual(search.search("alpha bravo charlie", "KJV", max_results), full[:max_results])
+
+    def test_reference_index(self):
+        """
+        Make sure that indexes of references from before verse IDs still load, as the same verses.
+        :return: None.
+        """
+        token_verses = {
+            "jesus": [("John", 11, 35), ("Revelation", 22, 21)],
+            "wept": [("Genesis", 1, 1), ("John", 11, 35)],
+        }
+        postings = {
+            token: [translate(*verse) for verse in verses] for token, verses in token_verses.items()
+        }
+        references = {
+            token: [
+                books[book] * 1_000_000 + chapter * 1_000 + verse for book, chapter, verse in verses
+            ]
+            for token, verses in token_verses.items()
+        }
+
+        verse_search = cBibleSearch()
+        verse_search.load(encode_index(postings), "KJV")
+        reference_search = cBibleSearch()
+        reference_search.load(encode_index(references), "KJV")
+        self.assertEqual(
+            verse_search.search("jesus wept", "KJV"),
+            ["John 11:35", "Genesis 1:1", "Revelation 22:21"]
+        )
+        self.assertEqual(
+            reference_search.search("jesus wept", "KJV"), verse_search.search("jesus wept", "KJV")
+        )
+
+        # Genesis 1:100 isn't a verse
+        references["wept"].append(1_001_100)
+        with self.assertRaises(RuntimeError):
+            cBibleSearch().load(encode_index(references), "KJV")
+
+    def test_phrase_search(self):
+        """
+        Make sure that phrases are only found with their words next to each other, in order, and in the same verse.
+        :return: None.
+        """
+        verses = {
+            translate("Genesis", 1, 1): "In the beginning God created the heaven and the earth.",
+            translate("Genesis", 1, 2): "And the earth was without form, and void; holy holy",
+            translate("Genesis", 1, 3): "And God said, Let there be light: and there was light. In",
+            translate("Genesis", 1, 4): "the beginning of light",
+            translate("John", 1, 1): "In the beginning was the Word",
+            translate("John", 11, 35): "Jesus wept.",
+            translate("John", 11, 36): "Then I said, wept Jesus? Jesus wept!",
+            translate("Revelation", 4, 8): "Holy, holy, holy, Lord God Almighty",
+        }
+        positions = {}
+        for verse_id, text in verses.items():
+            # Like the index, single letters but "a" aren't counted
+            tokens = [token for token in text.lower().replace(",", " ").replace(".", " ").replace(";", " ")
+                      .replace(":", " ").replace("?", " ").replace("!", " ").split()
+                      if len(token) > 1 or token == "a"]
+            for position, token in enumerate(tokens):
+                positions.setdefault(token, []).append(verse_id * 1024 + position)
+
+        search = cBibleSearch()
+        with tempfile.TemporaryDirectory() as temp_dir:
+            positions_path = os.path.join(temp_dir, "KJV.positions.json.pbz2")
+            with bz2.open(positions_path, "wt", encoding="utf-8") as positions_file:
+                positions_file.write(encode_index(positions))
+            with self.assertRaises(RuntimeError):
+                search.search_phrase("jesus wept", "KJV")
+            search.load_positions(positions_path, "KJV")
+
+            # Phrases that run over into the next verse aren't in either
+            self.assertEqual(search.search_phrase("in the beginning", "KJV"), ["Genesis 1:1", "John 1:1"])
+            self.assertEqual(search.search_phrase("In the beginning", "KJV", 1), ["Genesis 1:1"])
+            self.assertEqual(search.search_phrase("the beginning was", "KJV"), ["John 1:1"])
+            self.assertEqual(search.search_phrase("Jesus wept", "KJV"), ["John 11:35", "John 11:36"])
+            self.assertEqual(search.search_phrase("wept jesus jesus wept", "KJV"), ["John 11:36"])
+            self.assertEqual(search.search_phrase("then said", "KJV"), ["John 11:36"])
+            self.assertEqual(search.search_phrase("then I said", "KJV"), ["John 11:36"])
+            self.assertEqual(search.search_phrase("holy holy holy", "KJV"), ["Revelation 4:8"])
+            self.assertEqual(search.search_phrase("holy holy", "KJV"), ["Genesis 1:2", "Revelation 4:8"])
+            self.assertEqual(search.search_phrase("earth", "KJV"), ["Genesis 1:1", "Genesis 1:2"])
+            for phrase in ("god the", "jesus wept notawordinthebible", "in the beginning of", "", "I"):
+                with self.subTest(phrase=phrase):
+                    self.assertEqual(search.search_phrase(phrase, "KJV"), [])
+            # Each version has its own positions, and combined indices have none
+            with self.assertRaises(RuntimeError):
+                search.search_phrase("jesus wept", "ESV")
+            with self.assertRaises(RuntimeError):
+                search.load_positions(positions_path, "AllEng")
+
+            # They're unloaded along with the version
+            search.unload("KJV")
+            with self.assertRaises(RuntimeError):
+                search.search_phrase("jesus wept", "KJV")
+
+            # Positions past the end of the Bible are rejected
+            positions["wept"].append(translate("Revelation", 22, 21) * 1024 + 1024)
+            with bz2.open(positions_path, "wt", encoding="utf-8") as positions_file:
+                positions_file.write(encode_index(positions))
+            with self.assertRaises(RuntimeError):
+                search.load_positions(positions_path, "KJV")
+            with self.assertRaises(OSError):
+                search.load_positions(os.path.join(temp_dir, "missing.json.pbz2"), "KJV")
+
+    def test_simd_kernels(self):
+        """
+        Make sure that every level of SIMD kernels (decoding, merging, folding, tokenizing) gets the same results as the
+        scalar ones, each forced in a separate process.
+        :return: None.
+        """
+        script = """if True:
+            import json
+            from src.multi_bible_search.bible_search_adapter import BibleSearch
+            bible_search = BibleSearch()
+            queries = [
+                "Jesus wept", "the lord is my shepherd", "and the lord spake unto moses saying",
+                "God + LORD", "faith hope charity", "bless*",
+                "Then were the king's scribes called at that time in the third month, that is, the month Sivan, on the "
+                "three and twentieth day thereof; and it was written according to all that Mordecai commanded unto the "
+                "Jews, and to the lieutenants, and the deputies and rulers of the provinces which are from India unto "
+                "Ethiopia, an hundred twenty and seven provinces, unto every province according to the writing thereof, "
+                "and unto every people after their language, and to the Jews according to their writing, and according "
+                "to their language.",
+            ]
+            results = []
+            for version in ("KJV", "RV1960"):
+                for query in queries:
+                    results.append(bible_search.search(query, version))
+                    results.append(bible_search.search(query, version, 10))
+                    results.append(bible_search.search_boolean(query, version))
+            print(json.dumps(results))
+        """
+        root = os.path.join(os.path.dirname(__file__), "..")
+        results = {}
+        for level in ("scalar", "sse2", "ssse3", "sse4.2", "avx2"):
+            env = dict(os.environ, MULTI_BIBLE_SEARCH_SIMD=level)
+            process = subprocess.run([sys.executable, "-c", script], cwd=root, env=env, capture_output=True, text=True,
+                                     check=True)
+            results[level] = process.stdout
+        for level, output in results.items():
+            with self.subTest(level=level):
+                self.assertEqual(output, results["scalar"])
+
+
+def translate_reference(reference: str) -> int:
+    """
+    Get the verse ID of a reference string, like `rtranslate` returns.
+    :param reference: The reference, e.g. "John 11:35".
+    :return: The verse ID.
+    """
+    book, chapter_verse = reference.rsplit(" ", 1)
+    chapter, verse = chapter_verse.split(":")
+    return translate(book, int(chapter), int(verse))
+
+
+def encode_index(postings: dict) -> str:
+    """
+    Encode an index in the format of the data files.
+    :param postings: The sorted verse IDs (or references) of each token.
+    :return: The index as a string.
+    """
+    def base36(number: int) -> str:
+        digits = ""
+        while True:
+            number, digit = divmod(number, 36)
+            digits = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ"[digit] + digits
+            if not number:
+                return digits
+
+    return "{" + ",".join(
+        f"\"{token}\":[" + ",".join(base36(v) for v in values) + "]"
+        for token, values in postings.items()
+    ) + "}"
+
 
 if __name__ == '__main__':
     unittest.main()